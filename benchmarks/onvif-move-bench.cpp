@@ -0,0 +1,181 @@
+/* ONVIF continuous move benchmark
+ *
+ * Copyright 2026 agent <agent@local>
+ *
+ * SPDX-License-Identifier: GPLv2
+ *
+ * Drives a PTZOnvif device against scripts/onvifemu.py (or any ONVIF camera
+ * that is safe to swing around) and reports continuous move throughput,
+ * round trip percentiles and heap allocations per move. Each velocity update
+ * is issued through PTZDevice::pantilt() as soon as the previous one has
+ * completed, so the numbers cover the whole driver path: request build,
+ * authentication, the HTTP session and response handling.
+ *
+ * Allocations are counted by interposing malloc() and friends, which is only
+ * done with glibc. The count is process wide, so it includes the Qt network
+ * and plugin I/O threads.
+ *
+ * Usage: onvif-move-bench [host] [port] [moves] [username] [password]
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <QCoreApplication>
+#include <QDeadlineTimer>
+#include <QElapsedTimer>
+#include <QTimer>
+#include "ptz-device.hpp"
+#include "io-thread.hpp"
+#include "worker-pool.hpp"
+
+OBS_DECLARE_MODULE()
+
+/* Scene tracking lives in the OBS module glue, which isn't linked in */
+extern "C" bool ptz_scene_is_source_active(obs_source_t *scene, obs_source_t *source)
+{
+	Q_UNUSED(scene);
+	Q_UNUSED(source);
+	return false;
+}
+
+#if defined(__GLIBC__)
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_calloc(size_t nmemb, size_t size);
+extern "C" void *__libc_realloc(void *ptr, size_t size);
+
+static std::atomic<uint64_t> malloc_count;
+
+extern "C" void *malloc(size_t size)
+{
+	malloc_count.fetch_add(1, std::memory_order_relaxed);
+	return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t nmemb, size_t size)
+{
+	malloc_count.fetch_add(1, std::memory_order_relaxed);
+	return __libc_calloc(nmemb, size);
+}
+
+extern "C" void *realloc(void *ptr, size_t size)
+{
+	malloc_count.fetch_add(1, std::memory_order_relaxed);
+	return __libc_realloc(ptr, size);
+}
+
+static int64_t allocationCount()
+{
+	return (int64_t)malloc_count.load(std::memory_order_relaxed);
+}
+#else
+static int64_t allocationCount()
+{
+	return -1;
+}
+#endif
+
+static const int warmup_moves = 20;
+static const int move_timeout_ms = 5000;
+
+/* Run the event loop until the statistic changes from its current value */
+static bool waitForChange(obs_data_t *stats, const char *name, int timeout_ms)
+{
+	long long start = obs_data_get_int(stats, name);
+	QDeadlineTimer deadline(timeout_ms);
+	while (obs_data_get_int(stats, name) == start) {
+		if (deadline.hasExpired())
+			return false;
+		QCoreApplication::processEvents(QEventLoop::WaitForMoreEvents);
+	}
+	return true;
+}
+
+static double percentile(const QList<qint64> &sorted, int pct)
+{
+	qsizetype i = std::min(sorted.size() - 1, sorted.size() * pct / 100);
+	return sorted[i] / 1000000.0;
+}
+
+int main(int argc, char **argv)
+{
+	QCoreApplication app(argc, argv);
+	QString host = argc > 1 ? argv[1] : "127.0.0.1";
+	int port = argc > 2 ? atoi(argv[2]) : 8000;
+	int moves = argc > 3 ? atoi(argv[3]) : 1000;
+	QString username = argc > 4 ? argv[4] : "admin";
+	QString password = argc > 5 ? argv[5] : "password";
+	moves = std::max(moves, 1);
+
+	/* Wakes the event loop so timeouts are noticed */
+	QTimer wakeup;
+	wakeup.start(100);
+
+	OBSDataAutoRelease cfg = obs_data_create();
+	obs_data_set_string(cfg, "type", "onvif");
+	obs_data_set_string(cfg, "host", qUtf8Printable(host));
+	obs_data_set_int(cfg, "port", port);
+	obs_data_set_string(cfg, "username", qUtf8Printable(username));
+	obs_data_set_string(cfg, "password", qUtf8Printable(password));
+	PTZDevice *ptz = ptzDeviceList.make_device(cfg.Get());
+	if (!ptz) {
+		fprintf(stderr, "ONVIF support is not built in\n");
+		return 1;
+	}
+	OBSDataAutoRelease stats = obs_data_get_obj(ptz->get_settings(), "statistics");
+
+	/* The handshake is done once a profile has been selected */
+	QDeadlineTimer ready(move_timeout_ms);
+	while (!*obs_data_get_string(ptz->get_config(), "onvif_profile_token")) {
+		if (ready.hasExpired()) {
+			fprintf(stderr, "No ONVIF profile from %s:%i\n", qPrintable(host), port);
+			return 1;
+		}
+		QCoreApplication::processEvents(QEventLoop::WaitForMoreEvents);
+	}
+
+	QList<qint64> rtts;
+	rtts.reserve(moves);
+	QElapsedTimer elapsed, rtt;
+	int64_t allocs_start = 0;
+	long long requests_start = 0;
+	for (int i = -warmup_moves; i < moves; i++) {
+		if (i == 0) {
+			requests_start = obs_data_get_int(stats, "onvif_request_count");
+			allocs_start = allocationCount();
+			elapsed.start();
+		}
+		/* Alternate direction so that every update is a change */
+		rtt.start();
+		ptz->pantilt(i & 1 ? -0.5 : 0.5, 0.0);
+		if (!waitForChange(stats, "onvif_move_count", move_timeout_ms)) {
+			fprintf(stderr, "Move %i timed out\n", i);
+			return 1;
+		}
+		if (i >= 0)
+			rtts.append(rtt.nsecsElapsed());
+	}
+	qint64 total_ns = elapsed.nsecsElapsed();
+	int64_t allocs = allocationCount() - allocs_start;
+	long long requests = obs_data_get_int(stats, "onvif_request_count") - requests_start;
+
+	ptz->pantilt(0.0, 0.0);
+	waitForChange(stats, "onvif_move_count", move_timeout_ms);
+
+	std::sort(rtts.begin(), rtts.end());
+	printf("moves          %i\n", moves);
+	printf("moves/s        %.1f\n", moves * 1e9 / total_ns);
+	printf("requests/s     %.1f (including status polls)\n", requests * 1e9 / total_ns);
+	printf("p50 ms         %.3f\n", percentile(rtts, 50));
+	printf("p99 ms         %.3f\n", percentile(rtts, 99));
+	printf("max ms         %.3f\n", rtts.last() / 1000000.0);
+	if (allocs_start >= 0)
+		printf("allocs/move    %.1f\n", (double)allocs / moves);
+	else
+		printf("allocs/move    n/a\n");
+
+	delete ptz;
+	ptz_io_thread_stop();
+	PTZWorkerPool::shutdown();
+	return 0;
+}
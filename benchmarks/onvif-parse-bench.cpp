@@ -0,0 +1,72 @@
+/* ONVIF response parser benchmark
+ *
+ * Copyright 2026 agent <agent@local>
+ *
+ * SPDX-License-Identifier: GPLv2
+ *
+ * Times the streaming parser against the previous QDomDocument based parse
+ * (namespace processing plus three elementsByTagNameNS() sweeps) on the
+ * sample camera responses in scripts/onvif-responses/.
+ *
+ * Usage: onvif-parse-bench [responses-dir] [iterations]
+ */
+
+#include <cstdio>
+#include <QCoreApplication>
+#include <QDir>
+#include <QFile>
+#include <QElapsedTimer>
+#include <QtXml/QDomDocument>
+#include "onvif-parser.hpp"
+
+static int domParse(const QByteArray &xml)
+{
+	QDomDocument doc;
+#if QT_VERSION >= QT_VERSION_CHECK(6, 8, 0)
+	doc.setContent(QAnyStringView(xml), QDomDocument::ParseOption::UseNamespaceProcessing);
+#else
+	doc.setContent(xml, true);
+#endif
+	int count = doc.elementsByTagNameNS("http://www.onvif.org/ver10/device/wsdl", "GetCapabilitiesResponse")
+			    .length();
+	count += doc.elementsByTagNameNS("http://www.onvif.org/ver10/media/wsdl", "GetProfilesResponse").length();
+	count += doc.elementsByTagNameNS("http://www.onvif.org/ver20/ptz/wsdl", "Preset").length();
+	return count;
+}
+
+template<typename F> static double nsPerOp(int iterations, F func)
+{
+	QElapsedTimer timer;
+	timer.start();
+	for (int i = 0; i < iterations; i++)
+		func();
+	return (double)timer.nsecsElapsed() / iterations;
+}
+
+int main(int argc, char **argv)
+{
+	QCoreApplication app(argc, argv);
+	QString dir = argc > 1 ? argv[1] : ONVIF_RESPONSES_DIR;
+	int iterations = argc > 2 ? atoi(argv[2]) : 10000;
+
+	QDir responses(dir);
+	auto files = responses.entryList({"*.xml"}, QDir::Files, QDir::Name);
+	if (files.isEmpty()) {
+		fprintf(stderr, "No responses found in %s\n", qPrintable(dir));
+		return 1;
+	}
+
+	printf("%-24s %8s %12s %12s %8s\n", "response", "bytes", "dom ns/op", "stream ns/op", "speedup");
+	for (auto &name : files) {
+		QFile file(responses.filePath(name));
+		if (!file.open(QIODevice::ReadOnly))
+			continue;
+		QByteArray xml = file.readAll();
+		volatile int sink = 0;
+		double dom = nsPerOp(iterations, [&]() { sink = sink + domParse(xml); });
+		double stream = nsPerOp(iterations, [&]() { sink = sink + OnvifResponse::parse(xml).kind; });
+		printf("%-24s %8lld %12.0f %12.0f %7.1fx\n", qPrintable(name), (long long)xml.size(), dom, stream,
+		       dom / stream);
+	}
+	return 0;
+}
@@ -0,0 +1,405 @@
+#!/usr/bin/env python3
+#
+# ONVIF camera emulator for testing the ONVIF driver offline
+#
+# Serves the ONVIF device, media, PTZ and events services over keep-alive
+# HTTP/1.1 and simulates a PTZ head that integrates ContinuousMove velocities
+# and travels to presets. Move started/finished notifications are delivered to
+# PullPoint subscriptions through long-polled PullMessages. Every reply can be
+# delayed by a fixed latency plus random jitter to mimic a real camera, and HTTP
+# Digest authentication can be required.
+#
+# Camera N listens on <base-port + N>, matching the XAddrs advertised by
+# wsdiscovery-stub.py. Per-operation request counts and service times are
+# printed every few seconds while requests are arriving, and again on exit.
+#
+# Usage: onvifemu.py [--count 1] [--address 127.0.0.1] [--base-port 8000]
+#                    [--latency 0] [--jitter 0] [--digest]
+#                    [--username admin] [--password password]
+#                    [--profile-prefix PROFILE_] [--no-events]
+
+import argparse
+import asyncio
+import hashlib
+import random
+import re
+import time
+import uuid
+
+ENVELOPE = '''<?xml version="1.0" encoding="UTF-8"?>
+<SOAP-ENV:Envelope xmlns:SOAP-ENV="http://www.w3.org/2003/05/soap-envelope" xmlns:tt="http://www.onvif.org/ver10/schema" xmlns:tds="http://www.onvif.org/ver10/device/wsdl" xmlns:trt="http://www.onvif.org/ver10/media/wsdl" xmlns:tptz="http://www.onvif.org/ver20/ptz/wsdl" xmlns:ter="http://www.onvif.org/ver10/error" xmlns:tev="http://www.onvif.org/ver10/events/wsdl" xmlns:wsnt="http://docs.oasis-open.org/wsn/b-2" xmlns:wsa5="http://www.w3.org/2005/08/addressing" xmlns:tns1="http://www.onvif.org/ver10/topics">
+<SOAP-ENV:Header></SOAP-ENV:Header>
+<SOAP-ENV:Body>{body}</SOAP-ENV:Body>
+</SOAP-ENV:Envelope>'''
+
+FAULT = '''<SOAP-ENV:Fault><SOAP-ENV:Code><SOAP-ENV:Value>SOAP-ENV:{code}</SOAP-ENV:Value>{subcodes}</SOAP-ENV:Code><SOAP-ENV:Reason><SOAP-ENV:Text xml:lang="en">{text}</SOAP-ENV:Text></SOAP-ENV:Reason></SOAP-ENV:Fault>'''
+
+STATUS = '''<tptz:GetStatusResponse><tptz:PTZStatus><tt:Position><tt:PanTilt x="{pan:.4f}" y="{tilt:.4f}" space="http://www.onvif.org/ver10/tptz/PanTiltSpaces/PositionGenericSpace"/><tt:Zoom x="{zoom:.4f}" space="http://www.onvif.org/ver10/tptz/ZoomSpaces/PositionGenericSpace"/></tt:Position><tt:MoveStatus><tt:PanTilt>{pantilt_status}</tt:PanTilt><tt:Zoom>{zoom_status}</tt:Zoom></tt:MoveStatus><tt:UtcTime>{utc}</tt:UtcTime></tptz:PTZStatus></tptz:GetStatusResponse>'''
+
+NOTIFICATION = '''<wsnt:NotificationMessage><wsnt:Topic Dialect="http://www.onvif.org/ver10/tev/topicExpression/ConcreteSet">tns1:PTZController/PTZState</wsnt:Topic><wsnt:Message><tt:Message UtcTime="{utc}" PropertyOperation="Changed"><tt:Source><tt:SimpleItem Name="ProfileToken" Value="{profile}"/></tt:Source><tt:Data><tt:SimpleItem Name="MoveStatus" Value="{state}"/></tt:Data></tt:Message></wsnt:Message></wsnt:NotificationMessage>'''
+
+# Requests that a real camera answers without credentials
+UNAUTHENTICATED = {'GetSystemDateAndTime'}
+
+def clamp(val, min_val, max_val):
+    return max(min(val, max_val), min_val)
+
+# Subcodes nest, most specific last
+def fault(code, subcodes, reason):
+    nested = ''
+    for subcode in reversed(subcodes):
+        nested = '<SOAP-ENV:Subcode><SOAP-ENV:Value>ter:%s</SOAP-ENV:Value>%s</SOAP-ENV:Subcode>' % (subcode, nested)
+    return FAULT.format(code=code, subcodes=nested, text=reason)
+
+def md5(text):
+    return hashlib.md5(text.encode('utf-8')).hexdigest()
+
+def attr(xml, element, name, default=0.0):
+    m = re.search(r'<\w+:%s\b[^>]*\b%s="([^"]*)"' % (element, name), xml)
+    return float(m.group(1)) if m else default
+
+def text(xml, element, default=''):
+    m = re.search(r'<\w+:%s>([^<]*)</' % element, xml)
+    return m.group(1) if m else default
+
+def duration(xml, element, default):
+    m = re.search(r'PT(\d+(?:\.\d+)?)S', text(xml, element))
+    return float(m.group(1)) if m else default
+
+def utc_now():
+    return time.strftime('%Y-%m-%dT%H:%M:%SZ', time.gmtime())
+
+class Subscription:
+    def __init__(self, lifetime):
+        self.messages = []
+        self.wakeup = asyncio.Event()
+        self.renew(lifetime)
+
+    def renew(self, lifetime):
+        self.expires = time.time() + lifetime
+
+class Statistics:
+    def __init__(self):
+        self.ops = {}
+        self.reported = 0
+
+    def record(self, op, seconds):
+        self.ops.setdefault(op, []).append(seconds)
+
+    def report(self, title):
+        total = sum(len(v) for v in self.ops.values())
+        if total == self.reported:
+            return
+        self.reported = total
+        print(title)
+        print('  %-24s %8s %10s %10s %10s' % ('operation', 'count', 'p50 ms', 'p99 ms', 'max ms'))
+        for op, times in sorted(self.ops.items()):
+            times = sorted(times)
+            p50 = times[len(times) // 2] * 1000
+            p99 = times[min(len(times) - 1, len(times) * 99 // 100)] * 1000
+            print('  %-24s %8d %10.2f %10.2f %10.2f' % (op, len(times), p50, p99, times[-1] * 1000))
+
+class OnvifCamera:
+    def __init__(self, index, args, stats):
+        self.index = index
+        self.args = args
+        self.stats = stats
+        self.xaddr = 'http://%s:%d/onvif' % (args.address, args.base_port + index)
+        self.nonce = uuid.uuid4().hex
+        self.nonce_counts = {}
+        self.last_update = time.time()
+        self.pan = self.tilt = self.zoom = 0.0
+        self.panspeed = self.tiltspeed = self.zoomspeed = 0.0
+        self.target = None
+        self.profile_tokens = (args.profile_prefix + '000', args.profile_prefix + '001')
+        self.presets = {str(i): ('Preset %d' % i, (i - 4) / 4.0, (i % 3 - 1) / 2.0, i / 8.0) for i in range(1, 9)}
+        self.subscriptions = {}
+        self.next_subscription = 1
+        self.published = False
+
+    # Integrate the head position since the last request
+    def update(self):
+        now = time.time()
+        dt = now - self.last_update
+        self.last_update = now
+        if self.target:
+            done = True
+            pos = [self.pan, self.tilt, self.zoom]
+            for i, goal in enumerate(self.target):
+                step = clamp(goal - pos[i], -dt, dt)
+                pos[i] += step
+                done = done and abs(goal - pos[i]) < 1e-6
+            self.pan, self.tilt, self.zoom = pos
+            if done:
+                self.target = None
+        else:
+            self.pan = clamp(self.pan + self.panspeed * dt, -1.0, 1.0)
+            self.tilt = clamp(self.tilt + self.tiltspeed * dt, -1.0, 1.0)
+            self.zoom = clamp(self.zoom + self.zoomspeed * dt, 0.0, 1.0)
+
+    def moving(self):
+        return self.target is not None or any((self.panspeed, self.tiltspeed, self.zoomspeed))
+
+    # Notify subscribers when the head starts or stops moving
+    def publish(self):
+        state = self.moving()
+        if state == self.published:
+            return
+        self.published = state
+        message = NOTIFICATION.format(utc=utc_now(), profile=self.profile_tokens[0],
+                                      state='MOVING' if state else 'IDLE')
+        for sub in self.subscriptions.values():
+            sub.messages.append(message)
+            sub.wakeup.set()
+
+    # Presets are reached at full speed; report the arrival when it happens
+    def goto(self, target):
+        self.panspeed = self.tiltspeed = self.zoomspeed = 0.0
+        self.target = target
+        travel = max(abs(target[0] - self.pan), abs(target[1] - self.tilt), abs(target[2] - self.zoom))
+        asyncio.get_running_loop().call_later(travel + 0.01, self.settle)
+
+    def settle(self):
+        self.update()
+        self.publish()
+
+    def subscription(self, path):
+        for sid, sub in list(self.subscriptions.items()):
+            if sub.expires < time.time():
+                del self.subscriptions[sid]
+        m = re.search(r'/pullpoint/(\d+)$', path)
+        return self.subscriptions.get(int(m.group(1))) if m else None
+
+    def create_pull_point(self, xml):
+        sid = self.next_subscription
+        self.next_subscription += 1
+        self.subscriptions[sid] = Subscription(duration(xml, 'InitialTerminationTime', 60))
+        return ('<tev:CreatePullPointSubscriptionResponse><tev:SubscriptionReference>'
+                '<wsa5:Address>%s/event_service/pullpoint/%d</wsa5:Address></tev:SubscriptionReference>'
+                '<wsnt:CurrentTime>%s</wsnt:CurrentTime><wsnt:TerminationTime>%s</wsnt:TerminationTime>'
+                '</tev:CreatePullPointSubscriptionResponse>'
+                % (self.xaddr, sid, utc_now(), time.strftime('%Y-%m-%dT%H:%M:%SZ', time.gmtime(self.subscriptions[sid].expires))))
+
+    # Long poll: answer as soon as there are messages, or when the timeout expires
+    async def pull_messages(self, path, xml):
+        sub = self.subscription(path)
+        if not sub:
+            return fault('Sender', ['ResourceUnknown'], 'No such subscription')
+        if not sub.messages:
+            sub.wakeup.clear()
+            try:
+                await asyncio.wait_for(sub.wakeup.wait(), duration(xml, 'Timeout', 10))
+            except asyncio.TimeoutError:
+                pass
+        limit = int(text(xml, 'MessageLimit', '100') or 100)
+        messages, sub.messages = sub.messages[:limit], sub.messages[limit:]
+        return ('<tev:PullMessagesResponse><tev:CurrentTime>%s</tev:CurrentTime>'
+                '<tev:TerminationTime>%s</tev:TerminationTime>%s</tev:PullMessagesResponse>'
+                % (utc_now(), time.strftime('%Y-%m-%dT%H:%M:%SZ', time.gmtime(sub.expires)), ''.join(messages)))
+
+    # Returns None if the request is authorized, otherwise the challenge to send
+    def check_digest(self, method, headers):
+        challenge = 'Digest realm="onvifemu", qop="auth", nonce="%s", algorithm=MD5' % self.nonce
+        auth = headers.get('authorization', '')
+        if not auth.startswith('Digest '):
+            return challenge
+        fields = dict((m.group(1).lower(), m.group(2) if m.group(2) is not None else m.group(3))
+                      for m in re.finditer(r'(\w+)=(?:"([^"]*)"|([^,\s]*))', auth[7:]))
+        if fields.get('nonce') != self.nonce:
+            return challenge + ', stale=true'
+        if fields.get('username') != self.args.username:
+            return challenge
+        ha1 = md5('%s:onvifemu:%s' % (self.args.username, self.args.password))
+        ha2 = md5('%s:%s' % (method, fields.get('uri', '')))
+        if fields.get('qop') == 'auth':
+            nc = int(fields.get('nc', '0'), 16)
+            cnonce = fields.get('cnonce', '')
+            # Each nonce count may only be used once
+            if nc <= self.nonce_counts.get(cnonce, 0):
+                return challenge
+            self.nonce_counts[cnonce] = nc
+            expected = md5('%s:%s:%s:%s:auth:%s' % (ha1, self.nonce, fields['nc'], cnonce, ha2))
+        else:
+            expected = md5('%s:%s:%s' % (ha1, self.nonce, ha2))
+        return None if fields.get('response') == expected else challenge
+
+    def capabilities(self):
+        return ('<tds:GetCapabilitiesResponse><tds:Capabilities>'
+                '<tt:Device><tt:XAddr>{x}/device_service</tt:XAddr></tt:Device>'
+                '<tt:Media><tt:XAddr>{x}/media_service</tt:XAddr></tt:Media>'
+                '<tt:PTZ><tt:XAddr>{x}/ptz_service</tt:XAddr></tt:PTZ>{events}'
+                '</tds:Capabilities></tds:GetCapabilitiesResponse>').format(
+                    x=self.xaddr, events='' if self.args.no_events else
+                    '<tt:Events><tt:XAddr>%s/event_service</tt:XAddr><tt:WSPullPointSupport>true</tt:WSPullPointSupport></tt:Events>' % self.xaddr)
+
+    def profiles(self):
+        return ('<trt:GetProfilesResponse>'
+                '<trt:Profiles fixed="true" token="%s"><tt:Name>mainStream</tt:Name></trt:Profiles>'
+                '<trt:Profiles fixed="true" token="%s"><tt:Name>subStream</tt:Name></trt:Profiles>'
+                '</trt:GetProfilesResponse>' % self.profile_tokens)
+
+    def get_presets(self):
+        body = ''.join('<tptz:Preset token="%s"><tt:Name>%s</tt:Name><tt:PTZPosition>'
+                       '<tt:PanTilt x="%.4f" y="%.4f"/><tt:Zoom x="%.4f"/></tt:PTZPosition></tptz:Preset>'
+                       % (token, name, pan, tilt, zoom)
+                       for token, (name, pan, tilt, zoom) in sorted(self.presets.items(), key=lambda p: int(p[0])))
+        return '<tptz:GetPresetsResponse>%s</tptz:GetPresetsResponse>' % body
+
+    def status(self):
+        state = 'MOVING' if self.moving() else 'IDLE'
+        return STATUS.format(pan=self.pan, tilt=self.tilt, zoom=self.zoom, pantilt_status=state,
+                             zoom_status=state, utc=utc_now())
+
+    def date_and_time(self):
+        t = time.gmtime()
+        return ('<tds:GetSystemDateAndTimeResponse><tds:SystemDateAndTime>'
+                '<tt:DateTimeType>NTP</tt:DateTimeType><tt:DaylightSavings>false</tt:DaylightSavings>'
+                '<tt:UTCDateTime><tt:Time><tt:Hour>%d</tt:Hour><tt:Minute>%d</tt:Minute><tt:Second>%d</tt:Second></tt:Time>'
+                '<tt:Date><tt:Year>%d</tt:Year><tt:Month>%d</tt:Month><tt:Day>%d</tt:Day></tt:Date></tt:UTCDateTime>'
+                '</tds:SystemDateAndTime></tds:GetSystemDateAndTimeResponse>'
+                % (t.tm_hour, t.tm_min, t.tm_sec, t.tm_year, t.tm_mon, t.tm_mday))
+
+    def handle(self, op, path, xml):
+        self.update()
+        if op == 'GetSystemDateAndTime':
+            return self.date_and_time()
+        if op == 'GetCapabilities':
+            return self.capabilities()
+        if op == 'GetProfiles':
+            return self.profiles()
+        if op == 'CreatePullPointSubscription' and not self.args.no_events:
+            return self.create_pull_point(xml)
+        if op in ('Renew', 'Unsubscribe') and not self.args.no_events:
+            sub = self.subscription(path)
+            if not sub:
+                return fault('Sender', ['ResourceUnknown'], 'No such subscription')
+            if op == 'Unsubscribe':
+                self.subscriptions = {k: v for k, v in self.subscriptions.items() if v is not sub}
+                return '<wsnt:UnsubscribeResponse/>'
+            sub.renew(duration(xml, 'TerminationTime', 60))
+            return '<wsnt:RenewResponse><wsnt:TerminationTime>%s</wsnt:TerminationTime></wsnt:RenewResponse>' % \
+                time.strftime('%Y-%m-%dT%H:%M:%SZ', time.gmtime(sub.expires))
+        token = text(xml, 'ProfileToken', None)
+        if token is not None and token not in self.profile_tokens:
+            return fault('Sender', ['InvalidArgVal', 'NoProfile'], 'Unknown profile token')
+        if op == 'GetPresets':
+            return self.get_presets()
+        if op == 'GetStatus':
+            return self.status()
+        if op == 'ContinuousMove':
+            self.target = None
+            self.panspeed = clamp(attr(xml, 'PanTilt', 'x'), -1.0, 1.0)
+            self.tiltspeed = clamp(attr(xml, 'PanTilt', 'y'), -1.0, 1.0)
+            self.zoomspeed = clamp(attr(xml, 'Zoom', 'x'), -1.0, 1.0)
+            return '<tptz:ContinuousMoveResponse/>'
+        if op == 'Stop':
+            self.panspeed = self.tiltspeed = self.zoomspeed = 0.0
+            self.target = None
+            return '<tptz:StopResponse/>'
+        if op == 'GotoPreset':
+            preset = self.presets.get(text(xml, 'PresetToken'))
+            if not preset:
+                return fault('Sender', ['InvalidArgVal', 'NoToken'], 'No such preset')
+            self.goto(preset[1:])
+            return '<tptz:GotoPresetResponse/>'
+        if op == 'GotoHomePosition':
+            self.goto((0.0, 0.0, 0.0))
+            return '<tptz:GotoHomePositionResponse/>'
+        if op == 'SetPreset':
+            token = text(xml, 'PresetToken') or str(max(int(t) for t in self.presets) + 1 if self.presets else 1)
+            self.presets[token] = (text(xml, 'PresetName', 'Preset ' + token), self.pan, self.tilt, self.zoom)
+            return '<tptz:SetPresetResponse><tptz:PresetToken>%s</tptz:PresetToken></tptz:SetPresetResponse>' % token
+        if op == 'RemovePreset':
+            self.presets.pop(text(xml, 'PresetToken'), None)
+            return '<tptz:RemovePresetResponse/>'
+        return fault('Receiver', ['ActionNotSupported'], '%s is not supported' % op)
+
+    async def connection(self, reader, writer):
+        try:
+            while True:
+                request_line = await reader.readline()
+                if not request_line:
+                    break
+                method, path, _ = request_line.decode('latin-1').split(' ', 2)
+                headers = {}
+                while True:
+                    line = (await reader.readline()).decode('latin-1').strip()
+                    if not line:
+                        break
+                    key, _, value = line.partition(':')
+                    headers[key.strip().lower()] = value.strip()
+                body = await reader.readexactly(int(headers.get('content-length', '0')))
+                await self.respond(writer, method, path, headers, body.decode('utf-8', 'replace'))
+        except (asyncio.IncompleteReadError, ConnectionError, ValueError):
+            pass
+        writer.close()
+
+    async def respond(self, writer, method, path, headers, xml):
+        start = time.time()
+        m = re.search(r'<(?:\w+:)?Body[^>]*>\s*<\w+:(\w+)', xml)
+        op = m.group(1) if m else 'Unknown'
+
+        delay = (self.args.latency + random.uniform(0, self.args.jitter)) / 1000.0
+        if delay:
+            await asyncio.sleep(delay)
+
+        challenge = None
+        if self.args.digest and op not in UNAUTHENTICATED:
+            challenge = self.check_digest(method, headers)
+        if challenge:
+            status = '401 Unauthorized'
+            extra = 'WWW-Authenticate: %s\r\n' % challenge
+            payload = b''
+            op += ' (401)'
+        else:
+            if op == 'PullMessages' and not self.args.no_events:
+                reply = await self.pull_messages(path, xml)
+            else:
+                reply = self.handle(op, path, xml)
+                self.publish()
+            status = '500 Internal Server Error' if 'SOAP-ENV:Fault' in reply else '200 OK'
+            extra = 'Content-Type: application/soap+xml; charset=utf-8\r\n'
+            payload = ENVELOPE.format(body=reply).encode('utf-8')
+
+        writer.write(('HTTP/1.1 %s\r\n%sContent-Length: %d\r\nConnection: keep-alive\r\n\r\n'
+                      % (status, extra, len(payload))).encode('latin-1') + payload)
+        await writer.drain()
+        self.stats.record(op, time.time() - start)
+
+async def report(stats):
+    while True:
+        await asyncio.sleep(5)
+        stats.report(time.strftime('%H:%M:%S'))
+
+def main():
+    parser = argparse.ArgumentParser(description='ONVIF camera emulator')
+    parser.add_argument('--count', type=int, default=1, help='number of cameras to serve')
+    parser.add_argument('--address', default='127.0.0.1', help='address to listen on and advertise in XAddrs')
+    parser.add_argument('--base-port', type=int, default=8000, help='port of the first camera')
+    parser.add_argument('--latency', type=float, default=0, help='fixed reply latency in ms')
+    parser.add_argument('--jitter', type=float, default=0, help='additional random reply latency in ms')
+    parser.add_argument('--digest', action='store_true', help='require HTTP Digest authentication')
+    parser.add_argument('--username', default='admin')
+    parser.add_argument('--password', default='password')
+    parser.add_argument('--profile-prefix', default='PROFILE_',
+                        help='profile token prefix; change it to invalidate a cached profile token')
+    parser.add_argument('--no-events', action='store_true', help='act as a camera without an events service')
+    args = parser.parse_args()
+
+    stats = Statistics()
+    loop = asyncio.new_event_loop()
+    for i in range(args.count):
+        camera = OnvifCamera(i, args, stats)
+        loop.run_until_complete(asyncio.start_server(camera.connection, args.address, args.base_port + i))
+    print('ONVIF emulator: %d camera(s) on %s:%d-%d' % (args.count, args.address, args.base_port,
+                                                        args.base_port + args.count - 1))
+    loop.create_task(report(stats))
+    try:
+        loop.run_forever()
+    except KeyboardInterrupt:
+        pass
+    stats.reported = -1
+    stats.report('Totals')
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,82 @@
+#!/usr/bin/env python3
+#
+# WS-Discovery stub responder for testing ONVIF camera discovery
+#
+# Answers every Probe multicast to 239.255.255.250:3702 with one ProbeMatch per
+# simulated camera. Camera N advertises a device service at
+# http://<address>:<base-port + N>/onvif/device_service, so it can be pointed
+# at one or more instances of an ONVIF mock server.
+#
+# Usage: wsdiscovery-stub.py [--count 20] [--address 127.0.0.1] [--base-port 8000]
+
+import argparse
+import asyncio
+import re
+import socket
+import struct
+import uuid
+
+GROUP = '239.255.255.250'
+PORT = 3702
+
+MATCH = '''<?xml version="1.0" encoding="UTF-8"?>
+<e:Envelope xmlns:e="http://www.w3.org/2003/05/soap-envelope" xmlns:w="http://schemas.xmlsoap.org/ws/2004/08/addressing" xmlns:d="http://schemas.xmlsoap.org/ws/2005/04/discovery" xmlns:dn="http://www.onvif.org/ver10/network/wsdl">
+<e:Header>
+<w:MessageID>uuid:{message_id}</w:MessageID>
+<w:RelatesTo>{relates_to}</w:RelatesTo>
+<w:To>http://schemas.xmlsoap.org/ws/2004/08/addressing/role/anonymous</w:To>
+<w:Action>http://schemas.xmlsoap.org/ws/2005/04/discovery/ProbeMatches</w:Action>
+</e:Header>
+<e:Body><d:ProbeMatches><d:ProbeMatch>
+<w:EndpointReference><w:Address>urn:uuid:{endpoint}</w:Address></w:EndpointReference>
+<d:Types>dn:NetworkVideoTransmitter</d:Types>
+<d:Scopes>onvif://www.onvif.org/type/video_encoder onvif://www.onvif.org/type/ptz onvif://www.onvif.org/name/Stub%20Camera%20{index} onvif://www.onvif.org/hardware/STUB-PTZ</d:Scopes>
+<d:XAddrs>http://{address}:{port}/onvif/device_service</d:XAddrs>
+<d:MetadataVersion>1</d:MetadataVersion>
+</d:ProbeMatch></d:ProbeMatches></e:Body>
+</e:Envelope>'''
+
+class DiscoveryStub(asyncio.DatagramProtocol):
+    def __init__(self, args):
+        self.args = args
+        # Stable endpoint ids so repeated probes are recognized as the same camera
+        self.endpoints = [uuid.uuid5(uuid.NAMESPACE_URL, 'stub-camera-%d' % i) for i in range(args.count)]
+
+    def connection_made(self, transport):
+        self.transport = transport
+
+    def datagram_received(self, data, addr):
+        text = data.decode('utf-8', 'replace')
+        if 'Probe' not in text or 'ProbeMatches' in text:
+            return
+        m = re.search(r'MessageID[^>]*>([^<]+)<', text)
+        relates_to = m.group(1) if m else ''
+        print('Probe from %s:%d, answering with %d cameras' % (addr[0], addr[1], self.args.count))
+        for i, endpoint in enumerate(self.endpoints):
+            reply = MATCH.format(message_id=uuid.uuid4(), relates_to=relates_to, endpoint=endpoint,
+                                 index=i + 1, address=self.args.address, port=self.args.base_port + i)
+            self.transport.sendto(reply.encode('utf-8'), addr)
+
+def main():
+    parser = argparse.ArgumentParser(description='WS-Discovery stub responder')
+    parser.add_argument('--count', type=int, default=20, help='number of cameras to advertise')
+    parser.add_argument('--address', default='127.0.0.1', help='address advertised in XAddrs')
+    parser.add_argument('--base-port', type=int, default=8000, help='device service port of the first camera')
+    args = parser.parse_args()
+
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM, socket.IPPROTO_UDP)
+    sock.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    sock.bind(('', PORT))
+    mreq = struct.pack('4sl', socket.inet_aton(GROUP), socket.INADDR_ANY)
+    sock.setsockopt(socket.IPPROTO_IP, socket.IP_ADD_MEMBERSHIP, mreq)
+
+    loop = asyncio.new_event_loop()
+    loop.run_until_complete(loop.create_datagram_endpoint(lambda: DiscoveryStub(args), sock=sock))
+    print('WS-Discovery stub listening on %s:%d' % (GROUP, PORT))
+    try:
+        loop.run_forever()
+    except KeyboardInterrupt:
+        pass
+
+if __name__ == '__main__':
+    main()
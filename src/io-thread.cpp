@@ -0,0 +1,255 @@
+/* Transport I/O thread and lock-free hand-off queues
+ *
+ * Copyright 2026 agent <agent@local>
+ *
+ * SPDX-License-Identifier: GPLv2
+ */
+
+#include <algorithm>
+#include <QCoreApplication>
+#include <QHash>
+#include <util/platform.h>
+#include "ptz.h"
+#include "io-thread.hpp"
+
+static const int io_shard_max = 4;
+static QThread *io_threads[io_shard_max] = {};
+static QObject *io_contexts[io_shard_max] = {}; /* Context for work not tied to a transport */
+
+int ptz_io_shard_count()
+{
+	return std::clamp((int)QThread::idealThreadCount() / 2, 1, io_shard_max);
+}
+
+QThread *ptz_io_thread(int shard)
+{
+	shard = shard % ptz_io_shard_count();
+	if (!io_threads[shard]) {
+		auto thread = new QThread();
+		thread->setObjectName(QString("PTZ I/O %1").arg(shard));
+		thread->start(QThread::TimeCriticalPriority);
+		io_contexts[shard] = new QObject();
+		io_contexts[shard]->moveToThread(thread);
+		io_threads[shard] = thread;
+		blog(LOG_INFO, "Transport I/O thread %i started", shard);
+	}
+	return io_threads[shard];
+}
+
+static QObject *ptz_io_context(QThread *thread)
+{
+	for (int i = 0; i < io_shard_max; i++)
+		if (io_threads[i] == thread)
+			return io_contexts[i];
+	return nullptr;
+}
+
+void ptz_io_thread_stop()
+{
+	for (int i = 0; i < io_shard_max; i++) {
+		if (!io_threads[i])
+			continue;
+		io_threads[i]->quit();
+		io_threads[i]->wait();
+		delete io_contexts[i];
+		io_contexts[i] = nullptr;
+		delete io_threads[i];
+		io_threads[i] = nullptr;
+	}
+}
+
+void ptz_io_invoke(QObject *io_object, std::function<void()> func, bool blocking)
+{
+	if (QThread::currentThread() == io_object->thread()) {
+		func();
+		return;
+	}
+	QMetaObject::invokeMethod(io_object, func, blocking ? Qt::BlockingQueuedConnection : Qt::QueuedConnection);
+}
+
+void ptz_io_release(QObject *io_object)
+{
+	ptz_io_invoke(io_object, [io_object]() { io_object->disconnect(); }, true);
+	io_object->deleteLater();
+}
+
+void PTZIOChannel::send(PTZIOFrame &&frame)
+{
+	if (!tx_queue.push(std::move(frame))) {
+		tx_dropped++;
+		return;
+	}
+	if (PTZIOBurst::active()) {
+		PTZIOBurst::add(shared_from_this(), !tx_scheduled.exchange(true));
+		return;
+	}
+	if (tx_scheduled.exchange(true))
+		return;
+	auto self = shared_from_this();
+	QMetaObject::invokeMethod(io_context, [self]() { self->flush(); }, Qt::QueuedConnection);
+}
+
+void PTZIOChannel::flush()
+{
+	PTZIOFrame frame;
+	tx_scheduled.store(false);
+	if (transmit_batch) {
+		std::vector<PTZIOFrame> frames;
+		while (tx_queue.pop(frame))
+			frames.push_back(std::move(frame));
+		if (!frames.empty())
+			transmit_batch(frames);
+		return;
+	}
+	while (tx_queue.pop(frame)) {
+		if (transmit)
+			transmit(frame);
+	}
+}
+
+void PTZIOChannel::post(PTZIOFrame &&frame)
+{
+	frame.timestamp_ns = os_gettime_ns();
+	if (!rx_queue.push(std::move(frame))) {
+		rx_dropped++;
+		return;
+	}
+	if (rx_scheduled.exchange(true))
+		return;
+	auto self = shared_from_this();
+	QMetaObject::invokeMethod(ui_context, [self]() { self->drain(); }, Qt::QueuedConnection);
+}
+
+bool PTZIOChannel::drain()
+{
+	PTZIOFrame frame;
+	bool drained = false;
+	rx_scheduled.store(false);
+	while (rx_queue.pop(frame)) {
+		drained = true;
+		if (receive)
+			receive(frame);
+	}
+	return drained;
+}
+
+void PTZIOChannel::writeStatistics(obs_data_t *data) const
+{
+	obs_data_set_int(data, "io_tx_dropped", tx_dropped);
+	obs_data_set_int(data, "io_rx_dropped", rx_dropped);
+}
+
+int PTZIOBurst::depth = 0;
+uint64_t PTZIOBurst::queued = 0;
+std::vector<std::shared_ptr<PTZIOChannel>> PTZIOBurst::channels;
+std::vector<std::function<void()>> PTZIOBurst::deferred;
+std::vector<PTZIOBurst::ReleasedFunc> PTZIOBurst::released;
+
+PTZIOBurst::PTZIOBurst()
+{
+	depth++;
+}
+
+PTZIOBurst::~PTZIOBurst()
+{
+	if (--depth > 0)
+		return;
+
+	/* Channels may be spread over several I/O threads, and deferred writes
+	 * run on this one. Each thread sends its own part; the spread is
+	 * measured from the first send start on any thread to the last end */
+	struct BurstState {
+		std::atomic<int> remaining{0};
+		std::atomic<uint64_t> first_ns{UINT64_MAX};
+		std::atomic<uint64_t> last_ns{0};
+		size_t count = 0;
+		std::vector<ReleasedFunc> released;
+
+		void finish(uint64_t start, uint64_t end)
+		{
+			uint64_t first = first_ns;
+			while (start < first && !first_ns.compare_exchange_weak(first, start))
+				;
+			uint64_t last = last_ns;
+			while (end > last && !last_ns.compare_exchange_weak(last, end))
+				;
+			if (--remaining > 0)
+				return;
+
+			uint64_t spread = last_ns - first_ns;
+			blog(LOG_DEBUG, "I/O burst released %zu transports, spread %.3f ms", count,
+			     spread / 1000000.0);
+			auto funcs = std::move(released);
+			size_t transports = count;
+			QMetaObject::invokeMethod(
+				QCoreApplication::instance(),
+				[funcs, transports, spread]() {
+					for (auto &func : funcs)
+						func(transports, spread);
+				},
+				Qt::QueuedConnection);
+		}
+	};
+	auto state = std::make_shared<BurstState>();
+	auto calls = std::move(deferred);
+	deferred.clear();
+	state->released = std::move(released);
+	released.clear();
+	state->count = channels.size() + calls.size();
+	if (!state->count) {
+		for (auto &func : state->released)
+			func(0, 0);
+		return;
+	}
+
+	QHash<QThread *, std::vector<std::shared_ptr<PTZIOChannel>>> by_thread;
+	for (auto &ch : channels)
+		by_thread[ch->io_context->thread()].push_back(ch);
+	channels.clear();
+	state->remaining = (int)by_thread.size() + (calls.empty() ? 0 : 1);
+
+	for (auto it = by_thread.begin(); it != by_thread.end(); ++it) {
+		QObject *context = ptz_io_context(it.key());
+		auto burst = std::move(it.value());
+		if (!context)
+			context = burst.front()->io_context;
+		QMetaObject::invokeMethod(
+			context,
+			[burst, state]() {
+				uint64_t start = os_gettime_ns();
+				for (auto &ch : burst)
+					ch->flush();
+				state->finish(start, os_gettime_ns());
+			},
+			Qt::QueuedConnection);
+	}
+
+	if (!calls.empty()) {
+		uint64_t start = os_gettime_ns();
+		for (auto &call : calls)
+			call();
+		state->finish(start, os_gettime_ns());
+	}
+}
+
+void PTZIOBurst::add(std::shared_ptr<PTZIOChannel> channel, bool wakeup)
+{
+	queued++;
+	if (wakeup)
+		channels.push_back(channel);
+}
+
+void PTZIOBurst::defer(std::function<void()> func)
+{
+	if (!active()) {
+		func();
+		return;
+	}
+	queued++;
+	deferred.push_back(std::move(func));
+}
+
+void PTZIOBurst::onReleased(ReleasedFunc func)
+{
+	released.push_back(std::move(func));
+}
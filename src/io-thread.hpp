@@ -0,0 +1,162 @@
+/* Transport I/O thread and lock-free hand-off queues
+ *
+ * Copyright 2026 agent <agent@local>
+ *
+ * SPDX-License-Identifier: GPLv2
+ */
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <vector>
+#include <QByteArray>
+#include <QHostAddress>
+#include <QObject>
+#include <QThread>
+#include <obs.hpp>
+
+/*
+ * Single producer, single consumer lock-free ring buffer. One thread may call
+ * push() and one other thread may call pop(). Size must be a power of two.
+ */
+template<typename T, size_t Size> class SPSCQueue {
+	static_assert((Size & (Size - 1)) == 0, "SPSCQueue size must be a power of two");
+
+private:
+	std::array<T, Size> ring;
+	alignas(64) std::atomic<size_t> head{0}; /* next slot to pop */
+	alignas(64) std::atomic<size_t> tail{0}; /* next slot to push */
+
+public:
+	bool push(T &&item)
+	{
+		size_t t = tail.load(std::memory_order_relaxed);
+		if (t - head.load(std::memory_order_acquire) == Size)
+			return false;
+		ring[t & (Size - 1)] = std::move(item);
+		tail.store(t + 1, std::memory_order_release);
+		return true;
+	}
+
+	bool pop(T &item)
+	{
+		size_t h = head.load(std::memory_order_relaxed);
+		if (h == tail.load(std::memory_order_acquire))
+			return false;
+		item = std::move(ring[h & (Size - 1)]);
+		head.store(h + 1, std::memory_order_release);
+		return true;
+	}
+
+	bool empty() const { return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire); }
+};
+
+/* A frame passed between the UI thread and the I/O thread */
+struct PTZIOFrame {
+	QByteArray data;
+	QHostAddress address;
+	quint16 port = 0;
+	uint64_t timestamp_ns = 0;
+};
+
+/*
+ * PTZIOChannel - Carries frames between a protocol driver running on the UI
+ * thread and a transport object living on the I/O thread.
+ *
+ * Frames sent by the UI thread are queued and written by `transmit` on the I/O
+ * thread. Frames received by the transport are posted with `post()` and handed
+ * to `receive` on the UI thread. The queues themselves are lock free; a queued
+ * invocation is only used to wake the other side when a queue goes from empty
+ * to non-empty.
+ *
+ * Channels are reference counted so that wakeups already in flight remain
+ * valid while the owning objects are being torn down.
+ */
+class PTZIOChannel : public std::enable_shared_from_this<PTZIOChannel> {
+	friend class PTZIOBurst;
+
+private:
+	static const size_t queue_size = 256;
+	SPSCQueue<PTZIOFrame, queue_size> tx_queue;
+	SPSCQueue<PTZIOFrame, queue_size> rx_queue;
+	std::atomic<bool> tx_scheduled{false};
+	std::atomic<bool> rx_scheduled{false};
+	QObject *ui_context;
+	QObject *io_context;
+
+public:
+	std::function<void(PTZIOFrame &)> transmit; /* Called on the I/O thread */
+	/* Optional; if set, everything queued for one wakeup is passed at once */
+	std::function<void(std::vector<PTZIOFrame> &)> transmit_batch;
+	std::function<void(PTZIOFrame &)> receive;  /* Called on the UI thread */
+	std::atomic<uint64_t> tx_dropped{0};
+	std::atomic<uint64_t> rx_dropped{0};
+
+	PTZIOChannel(QObject *ui_context, QObject *io_context) : ui_context(ui_context), io_context(io_context) {}
+	static std::shared_ptr<PTZIOChannel> create(QObject *ui_context, QObject *io_context)
+	{
+		return std::make_shared<PTZIOChannel>(ui_context, io_context);
+	}
+
+	/* UI thread side */
+	void send(PTZIOFrame &&frame);
+	bool drain();
+
+	/* I/O thread side */
+	void post(PTZIOFrame &&frame);
+	void flush();
+
+	/* Frames lost because a queue was full, for the owning device */
+	void writeStatistics(obs_data_t *data) const;
+};
+
+/*
+ * PTZIOBurst - Release frames from several channels in one burst
+ *
+ * While a burst is open on the UI thread, frames sent on any channel are
+ * queued but the I/O thread is not woken. When the burst is released, a single
+ * wakeup flushes every participating channel back to back, so frames for
+ * different cameras leave as close together as possible. Transports that don't
+ * use a PTZIOChannel hold their writes back with defer(); those are run in one
+ * tight loop on the UI thread at release. The time between the first and last
+ * transmit is reported as the burst spread.
+ */
+class PTZIOBurst {
+public:
+	typedef std::function<void(size_t transports, uint64_t spread_ns)> ReleasedFunc;
+
+private:
+	static int depth;
+	static uint64_t queued;
+	static std::vector<std::shared_ptr<PTZIOChannel>> channels;
+	static std::vector<std::function<void()>> deferred;
+	static std::vector<ReleasedFunc> released;
+
+public:
+	PTZIOBurst();
+	~PTZIOBurst();
+	static bool active() { return depth > 0; }
+	static void add(std::shared_ptr<PTZIOChannel> channel, bool wakeup);
+	/* Run a write now, or at release if a burst is open */
+	static void defer(std::function<void()> func);
+	/* Frames and writes taken into bursts so far. A caller compares this
+	 * before and after issuing a command to tell whether it joined */
+	static uint64_t queuedCount() { return queued; }
+	/* Called on the UI thread once the enclosing burst has gone out */
+	static void onReleased(ReleasedFunc func);
+};
+
+/* Transports are spread over a small number of I/O threads ("shards").
+ * Shared transports use shard 0. */
+int ptz_io_shard_count();
+QThread *ptz_io_thread(int shard = 0);
+void ptz_io_thread_stop();
+
+/* Run a function on the I/O thread in the context of `io_object`. */
+void ptz_io_invoke(QObject *io_object, std::function<void()> func, bool blocking = false);
+
+/* Disconnect an I/O thread object from its owner and schedule it for deletion.
+ * Blocks until any handler already running on the I/O thread has returned. */
+void ptz_io_release(QObject *io_object);
@@ -0,0 +1,296 @@
+/* ONVIF WS-Discovery camera enumeration
+ *
+ * Copyright 2026 agent <agent@local>
+ *
+ * SPDX-License-Identifier: GPLv2
+ */
+
+#include <algorithm>
+#include <QDialogButtonBox>
+#include <QFormLayout>
+#include <QHeaderView>
+#include <QLineEdit>
+#include <QNetworkReply>
+#include <QPushButton>
+#include <QTreeWidget>
+#include <QUuid>
+#include <QVBoxLayout>
+#include <QXmlStreamReader>
+#include <qt-wrappers.hpp>
+#include "ptz-device.hpp"
+#include "ptz-onvif.hpp"
+#include "onvif-discovery.hpp"
+
+static const QHostAddress discovery_group("239.255.255.250");
+static const quint16 discovery_port = 3702;
+static constexpr QStringView nsDiscovery = u"http://schemas.xmlsoap.org/ws/2005/04/discovery";
+static constexpr QStringView nsDiscoveryAddressing = u"http://schemas.xmlsoap.org/ws/2004/08/addressing";
+
+static const char probe_template[] =
+	"<?xml version=\"1.0\" encoding=\"UTF-8\"?>"
+	"<e:Envelope xmlns:e=\"http://www.w3.org/2003/05/soap-envelope\""
+	" xmlns:w=\"http://schemas.xmlsoap.org/ws/2004/08/addressing\""
+	" xmlns:d=\"http://schemas.xmlsoap.org/ws/2005/04/discovery\""
+	" xmlns:dn=\"http://www.onvif.org/ver10/network/wsdl\">"
+	"<e:Header><w:MessageID>%1</w:MessageID>"
+	"<w:To e:mustUnderstand=\"true\">urn:schemas-xmlsoap-org:ws:2005:04:discovery</w:To>"
+	"<w:Action e:mustUnderstand=\"true\">http://schemas.xmlsoap.org/ws/2005/04/discovery/Probe</w:Action>"
+	"</e:Header><e:Body><d:Probe><d:Types>dn:NetworkVideoTransmitter</d:Types></d:Probe></e:Body>"
+	"</e:Envelope>";
+
+PTZOnvifDiscovery::PTZOnvifDiscovery(QObject *parent) : QObject(parent)
+{
+	probe_timer.setSingleShot(true);
+	connect(&probe_timer, &QTimer::timeout, this, &PTZOnvifDiscovery::checkFinished);
+	connect(&socket, &QUdpSocket::readyRead, this, &PTZOnvifDiscovery::readDatagrams);
+	connect(&network, &QNetworkAccessManager::finished, this, &PTZOnvifDiscovery::requestFinished);
+}
+
+void PTZOnvifDiscovery::start(const QString &username_, const QString &password_)
+{
+	username = username_;
+	password = password_;
+	devices.clear();
+	generation++;
+	outstanding = 0;
+	if (socket.state() != QAbstractSocket::BoundState && !socket.bind(QHostAddress::AnyIPv4, 0)) {
+		blog(LOG_WARNING, "ONVIF discovery: unable to bind socket: %s", QT_TO_UTF8(socket.errorString()));
+		emit finished();
+		return;
+	}
+
+	/* Multicast is unreliable; send the probe twice */
+	message_id = "uuid:" + QUuid::createUuid().toString(QUuid::WithoutBraces);
+	QByteArray probe = QString(probe_template).arg(message_id).toUtf8();
+	socket.writeDatagram(probe, discovery_group, discovery_port);
+	QTimer::singleShot(250, this, [this, probe]() { socket.writeDatagram(probe, discovery_group, discovery_port); });
+	probe_timer.start(probe_window_ms);
+}
+
+void PTZOnvifDiscovery::readDatagrams()
+{
+	while (socket.hasPendingDatagrams()) {
+		QByteArray datagram(socket.pendingDatagramSize(), Qt::Uninitialized);
+		socket.readDatagram(datagram.data(), datagram.size());
+		probeMatch(datagram);
+	}
+}
+
+void PTZOnvifDiscovery::probeMatch(const QByteArray &datagram)
+{
+	QXmlStreamReader s(datagram);
+	OnvifDiscoveredDevice device;
+	QString relates_to;
+	QStringList xaddrs;
+
+	while (!s.atEnd()) {
+		if (s.readNext() != QXmlStreamReader::StartElement)
+			continue;
+		if (s.namespaceUri() == nsDiscoveryAddressing && s.name() == u"RelatesTo") {
+			relates_to = s.readElementText();
+		} else if (s.namespaceUri() == nsDiscoveryAddressing && s.name() == u"Address") {
+			device.endpoint = s.readElementText().trimmed();
+		} else if (s.namespaceUri() == nsDiscovery && s.name() == u"XAddrs") {
+			xaddrs = s.readElementText().split(' ', Qt::SkipEmptyParts);
+		} else if (s.namespaceUri() == nsDiscovery && s.name() == u"Scopes") {
+			for (auto &scope : s.readElementText().split(' ', Qt::SkipEmptyParts)) {
+				QUrl url(scope);
+				QString path = url.path();
+				if (path.startsWith("/name/"))
+					device.name = QUrl::fromPercentEncoding(path.mid(6).toUtf8());
+				else if (path.startsWith("/hardware/"))
+					device.hardware = QUrl::fromPercentEncoding(path.mid(10).toUtf8());
+			}
+		}
+	}
+
+	/* Ignore stray matches for other clients' probes */
+	if (!relates_to.isEmpty() && relates_to != message_id)
+		return;
+	if (xaddrs.isEmpty())
+		return;
+	if (device.endpoint.isEmpty())
+		device.endpoint = xaddrs[0];
+	if (devices.contains(device.endpoint))
+		return;
+
+	/* The ONVIF driver only speaks plain http; prefer an http address and
+	 * list https-only cameras without interrogating them */
+	auto xaddr = std::find_if(xaddrs.cbegin(), xaddrs.cend(),
+				  [](const QString &addr) { return QUrl(addr).scheme() == "http"; });
+	device.deviceService = QUrl(xaddr != xaddrs.cend() ? *xaddr : xaddrs[0]);
+	if (device.deviceService.scheme() != "http")
+		device.error = "HTTPS is not supported";
+	devices[device.endpoint] = device;
+	emit deviceUpdated(device);
+	if (device.error.isEmpty())
+		post(device.endpoint, device.deviceService,
+		     "<tds:GetCapabilities><tds:Category>All</tds:Category></tds:GetCapabilities>");
+}
+
+void PTZOnvifDiscovery::post(const QString &endpoint, const QUrl &url, const QByteArray &body)
+{
+	QNetworkRequest request(url);
+	request.setHeader(QNetworkRequest::ContentTypeHeader, "application/soap+xml");
+	request.setTransferTimeout(request_timeout_ms);
+	QNetworkReply *reply = network.post(request, PTZOnvif::buildRequest(username, password, body));
+	reply->setProperty("onvif_endpoint", endpoint);
+	reply->setProperty("onvif_generation", generation);
+	outstanding++;
+}
+
+void PTZOnvifDiscovery::requestFinished(QNetworkReply *reply)
+{
+	reply->deleteLater();
+	if (reply->property("onvif_generation").toInt() != generation)
+		return;
+	outstanding--;
+	auto it = devices.find(reply->property("onvif_endpoint").toString());
+	if (it == devices.end()) {
+		checkFinished();
+		return;
+	}
+	OnvifDiscoveredDevice &device = it.value();
+
+	OnvifResponse response = OnvifResponse::parse(reply->readAll());
+	switch (response.kind) {
+	case OnvifResponse::Capabilities:
+		device.ptz = !response.ptzXAddr.isEmpty();
+		device.ptzXAddr = response.ptzXAddr;
+		device.mediaXAddr = response.mediaXAddr;
+		if (!device.mediaXAddr.isEmpty())
+			post(device.endpoint, QUrl(device.mediaXAddr), "<trt:GetProfiles/>");
+		break;
+	case OnvifResponse::Profiles:
+		device.profiles = response.profiles;
+		break;
+	case OnvifResponse::Fault:
+		device.error = response.fault;
+		break;
+	default:
+		if (reply->error() != QNetworkReply::NoError)
+			device.error = reply->errorString();
+		break;
+	}
+	emit deviceUpdated(device);
+	checkFinished();
+}
+
+void PTZOnvifDiscovery::checkFinished()
+{
+	if (!isRunning())
+		emit finished();
+}
+
+PTZOnvifDiscoveryDialog::PTZOnvifDiscoveryDialog(QWidget *parent) : QDialog(parent)
+{
+	setWindowTitle("Discover ONVIF Cameras");
+	setAttribute(Qt::WA_DeleteOnClose);
+
+	username_edit = new QLineEdit("admin", this);
+	password_edit = new QLineEdit(this);
+	password_edit->setEchoMode(QLineEdit::Password);
+	scan_button = new QPushButton("Scan", this);
+	auto form = new QFormLayout();
+	form->addRow("Username", username_edit);
+	form->addRow("Password", password_edit);
+	form->addRow(scan_button);
+
+	tree = new QTreeWidget(this);
+	tree->setHeaderLabels({"Camera", "Address", "PTZ", "Profiles"});
+	tree->setRootIsDecorated(false);
+	tree->header()->setSectionResizeMode(QHeaderView::ResizeToContents);
+
+	auto buttons = new QDialogButtonBox(QDialogButtonBox::Cancel, this);
+	add_button = buttons->addButton("Add Selected", QDialogButtonBox::AcceptRole);
+	add_button->setEnabled(false);
+
+	auto layout = new QVBoxLayout(this);
+	layout->addLayout(form);
+	layout->addWidget(tree);
+	layout->addWidget(buttons);
+	resize(640, 400);
+
+	connect(scan_button, &QPushButton::clicked, this, &PTZOnvifDiscoveryDialog::scan);
+	connect(buttons, &QDialogButtonBox::accepted, this, &PTZOnvifDiscoveryDialog::addSelected);
+	connect(buttons, &QDialogButtonBox::rejected, this, &QDialog::reject);
+	connect(&discovery, &PTZOnvifDiscovery::deviceUpdated, this, &PTZOnvifDiscoveryDialog::deviceUpdated);
+	connect(&discovery, &PTZOnvifDiscovery::finished, this, [this]() {
+		scan_button->setEnabled(true);
+		scan_button->setText("Scan");
+	});
+}
+
+void PTZOnvifDiscoveryDialog::scan()
+{
+	tree->clear();
+	items.clear();
+	found.clear();
+	add_button->setEnabled(false);
+	scan_button->setEnabled(false);
+	scan_button->setText("Scanning...");
+	discovery.start(username_edit->text(), password_edit->text());
+}
+
+void PTZOnvifDiscoveryDialog::deviceUpdated(const OnvifDiscoveredDevice &device)
+{
+	QTreeWidgetItem *item = items.value(device.endpoint);
+	if (!item) {
+		item = new QTreeWidgetItem(tree);
+		item->setFlags(item->flags() | Qt::ItemIsUserCheckable);
+		item->setCheckState(0, Qt::Unchecked);
+		items[device.endpoint] = item;
+		add_button->setEnabled(true);
+	}
+	found[device.endpoint] = device;
+
+	QString name = device.name.isEmpty() ? device.hardware : device.name;
+	item->setText(0, name.isEmpty() ? device.endpoint : name);
+	item->setText(1, device.deviceService.authority());
+	item->setText(2, device.mediaXAddr.isEmpty() ? "" : (device.ptz ? "Yes" : "No"));
+	if (!device.error.isEmpty())
+		item->setText(3, device.error);
+	else if (!device.profiles.isEmpty())
+		item->setText(3, QString("%1 (%2)").arg(device.profiles.size()).arg(device.profiles[0].name));
+	else
+		item->setText(3, "");
+}
+
+void PTZOnvifDiscoveryDialog::addSelected()
+{
+	for (auto it = items.constBegin(); it != items.constEnd(); it++) {
+		if (it.value()->checkState(0) != Qt::Checked)
+			continue;
+		const OnvifDiscoveredDevice &device = found[it.key()];
+		const QUrl &url = device.deviceService;
+		if (url.scheme() != "http") {
+			blog(LOG_WARNING, "ONVIF discovery: %s only offers %s, not adding it",
+			     QT_TO_UTF8(device.endpoint), QT_TO_UTF8(url.scheme()));
+			continue;
+		}
+		QString username = username_edit->text().isEmpty() ? "admin" : username_edit->text();
+		QString path = url.path().isEmpty() ? PTZOnvif::default_device_path : url.path();
+		OBSData cfg = obs_data_create();
+		obs_data_release(cfg);
+		obs_data_set_string(cfg, "type", "onvif");
+		obs_data_set_string(cfg, "host", QT_TO_UTF8(url.host()));
+		obs_data_set_int(cfg, "port", url.port(80));
+		if (path != PTZOnvif::default_device_path)
+			obs_data_set_string(cfg, "device_service_path", QT_TO_UTF8(path));
+		obs_data_set_string(cfg, "username", QT_TO_UTF8(username));
+		obs_data_set_string(cfg, "password", QT_TO_UTF8(password_edit->text()));
+
+		/* Seed the service handshake cache with what discovery has
+		 * already fetched, so the camera can be driven immediately */
+		if (!device.ptzXAddr.isEmpty() && !device.profiles.isEmpty()) {
+			QString endpoint = PTZOnvif::handshakeEndpoint(username, url.host(), url.port(80), path);
+			obs_data_set_string(cfg, "onvif_endpoint", QT_TO_UTF8(endpoint));
+			obs_data_set_string(cfg, "onvif_ptz_xaddr", QT_TO_UTF8(device.ptzXAddr));
+			obs_data_set_string(cfg, "onvif_media_xaddr", QT_TO_UTF8(device.mediaXAddr));
+			obs_data_set_string(cfg, "onvif_profile_token", QT_TO_UTF8(device.profiles[0].token));
+			obs_data_set_string(cfg, "onvif_profile_name", QT_TO_UTF8(device.profiles[0].name));
+		}
+		ptzDeviceList.make_device(cfg);
+	}
+	accept();
+}
@@ -0,0 +1,101 @@
+/* ONVIF WS-Discovery camera enumeration
+ *
+ * Copyright 2026 agent <agent@local>
+ *
+ * SPDX-License-Identifier: GPLv2
+ */
+#pragma once
+
+#include <QDialog>
+#include <QHash>
+#include <QNetworkAccessManager>
+#include <QTimer>
+#include <QUdpSocket>
+#include <QUrl>
+#include "onvif-parser.hpp"
+
+class QLineEdit;
+class QPushButton;
+class QTreeWidget;
+class QTreeWidgetItem;
+
+class OnvifDiscoveredDevice {
+public:
+	QString endpoint; /* WS-Addressing endpoint reference, e.g. urn:uuid:... */
+	QUrl deviceService;
+	QString name;
+	QString hardware;
+	bool ptz = false;
+	QString ptzXAddr;
+	QString mediaXAddr;
+	QList<MediaProfile> profiles;
+	QString error;
+};
+
+/*
+ * PTZOnvifDiscovery - Enumerate ONVIF cameras on the local network
+ *
+ * A WS-Discovery Probe is multicast to 239.255.255.250:3702 and every
+ * ProbeMatch that arrives within the probe window is reported. For each
+ * responder GetCapabilities and then GetProfiles are requested immediately,
+ * so all cameras are interrogated concurrently instead of one after another.
+ */
+class PTZOnvifDiscovery : public QObject {
+	Q_OBJECT
+
+private:
+	static const int probe_window_ms = 3000;
+	static const int request_timeout_ms = 3000;
+
+	QUdpSocket socket;
+	QNetworkAccessManager network;
+	QTimer probe_timer;
+	QString message_id;
+	QString username;
+	QString password;
+	QHash<QString, OnvifDiscoveredDevice> devices;
+	/* Requests of the current scan; replies from an earlier scan are
+	 * recognized by their generation and dropped */
+	int generation = 0;
+	int outstanding = 0;
+
+	void readDatagrams();
+	void probeMatch(const QByteArray &datagram);
+	void post(const QString &endpoint, const QUrl &url, const QByteArray &body);
+	void requestFinished(QNetworkReply *reply);
+	void checkFinished();
+
+public:
+	PTZOnvifDiscovery(QObject *parent = nullptr);
+	void start(const QString &username, const QString &password);
+	bool isRunning() const { return probe_timer.isActive() || outstanding > 0; }
+
+signals:
+	void deviceUpdated(const OnvifDiscoveredDevice &device);
+	void finished();
+};
+
+/*
+ * PTZOnvifDiscoveryDialog - Lists discovered cameras and adds the selected
+ * ones as ONVIF devices
+ */
+class PTZOnvifDiscoveryDialog : public QDialog {
+	Q_OBJECT
+
+private:
+	PTZOnvifDiscovery discovery;
+	QLineEdit *username_edit;
+	QLineEdit *password_edit;
+	QPushButton *scan_button;
+	QPushButton *add_button;
+	QTreeWidget *tree;
+	QHash<QString, QTreeWidgetItem *> items;
+	QHash<QString, OnvifDiscoveredDevice> found;
+
+	void scan();
+	void deviceUpdated(const OnvifDiscoveredDevice &device);
+	void addSelected();
+
+public:
+	PTZOnvifDiscoveryDialog(QWidget *parent = nullptr);
+};
@@ -0,0 +1,246 @@
+/* Streaming ONVIF SOAP response parser
+ *
+ * Copyright 2026 agent <agent@local>
+ *
+ * SPDX-License-Identifier: GPLv2
+ */
+
+#include <QTimeZone>
+#include <QXmlStreamReader>
+#include "onvif-parser.hpp"
+
+static constexpr QStringView nsSoapEnvelope = u"http://www.w3.org/2003/05/soap-envelope";
+static constexpr QStringView nsOnvifSchema = u"http://www.onvif.org/ver10/schema";
+static constexpr QStringView nsOnvifDevice = u"http://www.onvif.org/ver10/device/wsdl";
+static constexpr QStringView nsOnvifMedia = u"http://www.onvif.org/ver10/media/wsdl";
+static constexpr QStringView nsOnvifPtz = u"http://www.onvif.org/ver20/ptz/wsdl";
+static constexpr QStringView nsOnvifEvents = u"http://www.onvif.org/ver10/events/wsdl";
+static constexpr QStringView nsNotification = u"http://docs.oasis-open.org/wsn/b-2";
+
+static bool isElement(const QXmlStreamReader &s, QStringView ns, QStringView name)
+{
+	return s.name() == name && s.namespaceUri() == ns;
+}
+
+/* Text of the first direct child element ns:name; the reader is left on the
+ * end of the current element */
+static QString readChildText(QXmlStreamReader &s, QStringView ns, QStringView name)
+{
+	QString text;
+	while (s.readNextStartElement()) {
+		if (text.isNull() && isElement(s, ns, name))
+			text = s.readElementText(QXmlStreamReader::SkipChildElements);
+		else
+			s.skipCurrentElement();
+	}
+	return text;
+}
+
+/* Reads the integer children of a tt:Date or tt:Time element */
+static void readFields(QXmlStreamReader &s, int *fields, const QStringView *names, int count)
+{
+	while (s.readNextStartElement()) {
+		int i = 0;
+		while (i < count && s.name() != names[i])
+			i++;
+		if (i < count)
+			fields[i] = s.readElementText(QXmlStreamReader::SkipChildElements).toInt();
+		else
+			s.skipCurrentElement();
+	}
+}
+
+static void parseSystemDateAndTime(QXmlStreamReader &s, OnvifResponse &r)
+{
+	static const QStringView date_names[] = {u"Year", u"Month", u"Day"};
+	static const QStringView time_names[] = {u"Hour", u"Minute", u"Second"};
+
+	r.kind = OnvifResponse::SystemDateAndTime;
+	while (!s.atEnd()) {
+		if (s.readNext() != QXmlStreamReader::StartElement || !isElement(s, nsOnvifSchema, u"UTCDateTime"))
+			continue;
+		int date[3] = {0, 0, 0}, time[3] = {0, 0, 0};
+		while (s.readNextStartElement()) {
+			if (isElement(s, nsOnvifSchema, u"Date"))
+				readFields(s, date, date_names, 3);
+			else if (isElement(s, nsOnvifSchema, u"Time"))
+				readFields(s, time, time_names, 3);
+			else
+				s.skipCurrentElement();
+		}
+		r.utcTime = QDateTime(QDate(date[0], date[1], date[2]), QTime(time[0], time[1], time[2]),
+				      QTimeZone::utc());
+		return;
+	}
+}
+
+static void parseCapabilities(QXmlStreamReader &s, OnvifResponse &r)
+{
+	r.kind = OnvifResponse::Capabilities;
+	while (!s.atEnd()) {
+		if (s.readNext() != QXmlStreamReader::StartElement)
+			continue;
+		if (isElement(s, nsOnvifSchema, u"PTZ"))
+			r.ptzXAddr = readChildText(s, nsOnvifSchema, u"XAddr");
+		else if (isElement(s, nsOnvifSchema, u"Media"))
+			r.mediaXAddr = readChildText(s, nsOnvifSchema, u"XAddr");
+		else if (isElement(s, nsOnvifSchema, u"Events"))
+			r.eventsXAddr = readChildText(s, nsOnvifSchema, u"XAddr");
+	}
+}
+
+static void parseProfiles(QXmlStreamReader &s, OnvifResponse &r)
+{
+	r.kind = OnvifResponse::Profiles;
+	while (!s.atEnd()) {
+		if (s.readNext() != QXmlStreamReader::StartElement || !isElement(s, nsOnvifMedia, u"Profiles"))
+			continue;
+		MediaProfile profile;
+		profile.token = s.attributes().value(u"token").toString();
+		profile.name = readChildText(s, nsOnvifSchema, u"Name");
+		r.profiles.append(profile);
+	}
+}
+
+static void parsePresets(QXmlStreamReader &s, OnvifResponse &r)
+{
+	r.kind = OnvifResponse::Presets;
+	while (!s.atEnd()) {
+		if (s.readNext() != QXmlStreamReader::StartElement || !isElement(s, nsOnvifPtz, u"Preset"))
+			continue;
+		OnvifPreset preset;
+		preset.token = s.attributes().value(u"token").toString();
+		preset.name = readChildText(s, nsOnvifSchema, u"Name");
+		if (!preset.token.isEmpty())
+			r.presets.append(preset);
+	}
+}
+
+static void parseStatus(QXmlStreamReader &s, OnvifResponse &r)
+{
+	r.kind = OnvifResponse::Status;
+	while (!s.atEnd()) {
+		if (s.readNext() != QXmlStreamReader::StartElement)
+			continue;
+		if (isElement(s, nsOnvifSchema, u"Position")) {
+			while (s.readNextStartElement()) {
+				if (isElement(s, nsOnvifSchema, u"PanTilt")) {
+					r.pan = s.attributes().value(u"x").toDouble();
+					r.tilt = s.attributes().value(u"y").toDouble();
+					r.hasPosition = true;
+				} else if (isElement(s, nsOnvifSchema, u"Zoom")) {
+					r.zoom = s.attributes().value(u"x").toDouble();
+					r.hasPosition = true;
+				}
+				s.skipCurrentElement();
+			}
+		} else if (isElement(s, nsOnvifSchema, u"MoveStatus")) {
+			while (s.readNextStartElement()) {
+				if (s.readElementText(QXmlStreamReader::SkipChildElements) == u"MOVING")
+					r.moving = true;
+			}
+		}
+	}
+}
+
+static void parsePullPointSubscription(QXmlStreamReader &s, OnvifResponse &r)
+{
+	r.kind = OnvifResponse::PullPointSubscription;
+	while (!s.atEnd()) {
+		if (s.readNext() != QXmlStreamReader::StartElement || !isElement(s, nsOnvifEvents, u"SubscriptionReference"))
+			continue;
+		/* Cameras differ on the WS-Addressing version, so match any */
+		while (s.readNextStartElement()) {
+			if (s.name() == u"Address")
+				r.subscriptionAddress = s.readElementText(QXmlStreamReader::SkipChildElements).trimmed();
+			else
+				s.skipCurrentElement();
+		}
+		return;
+	}
+}
+
+static void parsePullMessages(QXmlStreamReader &s, OnvifResponse &r)
+{
+	r.kind = OnvifResponse::PullMessages;
+	while (!s.atEnd()) {
+		if (s.readNext() != QXmlStreamReader::StartElement ||
+		    !isElement(s, nsNotification, u"NotificationMessage"))
+			continue;
+		OnvifNotification notification;
+		bool in_data = false;
+		while (!s.atEnd()) {
+			auto token = s.readNext();
+			if (token == QXmlStreamReader::EndElement) {
+				if (isElement(s, nsOnvifSchema, u"Data"))
+					in_data = false;
+				else if (isElement(s, nsNotification, u"NotificationMessage"))
+					break;
+				continue;
+			}
+			if (token != QXmlStreamReader::StartElement)
+				continue;
+			if (isElement(s, nsNotification, u"Topic"))
+				notification.topic = s.readElementText(QXmlStreamReader::SkipChildElements).trimmed();
+			else if (isElement(s, nsOnvifSchema, u"Data"))
+				in_data = true;
+			else if (in_data && isElement(s, nsOnvifSchema, u"SimpleItem"))
+				notification.data.append({s.attributes().value(u"Name").toString(),
+							  s.attributes().value(u"Value").toString()});
+		}
+		r.notifications.append(notification);
+	}
+}
+
+static void parseFault(QXmlStreamReader &s, OnvifResponse &r)
+{
+	r.kind = OnvifResponse::Fault;
+	while (!s.atEnd()) {
+		if (s.readNext() != QXmlStreamReader::StartElement)
+			continue;
+		/* Subcodes nest, so the last Value seen is the most specific */
+		if (isElement(s, nsSoapEnvelope, u"Value")) {
+			QString code = s.readElementText(QXmlStreamReader::SkipChildElements).trimmed();
+			r.faultCode = code.mid(code.indexOf(':') + 1);
+		} else if (isElement(s, nsSoapEnvelope, u"Text")) {
+			r.fault = s.readElementText(QXmlStreamReader::SkipChildElements);
+			return;
+		}
+	}
+}
+
+OnvifResponse OnvifResponse::parse(const QByteArray &xml)
+{
+	OnvifResponse r;
+	QXmlStreamReader s(xml);
+
+	/* Skip ahead to the first element inside the SOAP Body */
+	bool in_body = false;
+	while (!s.atEnd()) {
+		if (s.readNext() != QXmlStreamReader::StartElement)
+			continue;
+		if (in_body)
+			break;
+		in_body = isElement(s, nsSoapEnvelope, u"Body");
+	}
+	if (s.tokenType() != QXmlStreamReader::StartElement || !in_body)
+		return r;
+
+	if (isElement(s, nsOnvifDevice, u"GetSystemDateAndTimeResponse"))
+		parseSystemDateAndTime(s, r);
+	else if (isElement(s, nsOnvifDevice, u"GetCapabilitiesResponse"))
+		parseCapabilities(s, r);
+	else if (isElement(s, nsOnvifMedia, u"GetProfilesResponse"))
+		parseProfiles(s, r);
+	else if (isElement(s, nsOnvifPtz, u"GetPresetsResponse"))
+		parsePresets(s, r);
+	else if (isElement(s, nsOnvifPtz, u"GetStatusResponse"))
+		parseStatus(s, r);
+	else if (isElement(s, nsOnvifEvents, u"CreatePullPointSubscriptionResponse"))
+		parsePullPointSubscription(s, r);
+	else if (isElement(s, nsOnvifEvents, u"PullMessagesResponse"))
+		parsePullMessages(s, r);
+	else if (isElement(s, nsSoapEnvelope, u"Fault"))
+		parseFault(s, r);
+	return r;
+}
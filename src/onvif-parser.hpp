@@ -0,0 +1,81 @@
+/* Streaming ONVIF SOAP response parser
+ *
+ * Copyright 2026 agent <agent@local>
+ *
+ * SPDX-License-Identifier: GPLv2
+ */
+#pragma once
+
+#include <QByteArray>
+#include <QDateTime>
+#include <QList>
+#include <QPair>
+#include <QString>
+
+class MediaProfile {
+public:
+	QString name;
+	QString token;
+};
+
+class OnvifPreset {
+public:
+	QString token;
+	QString name;
+};
+
+/* An event from a PullMessages response, with the Data SimpleItems */
+class OnvifNotification {
+public:
+	QString topic;
+	QList<QPair<QString, QString>> data;
+};
+
+/*
+ * OnvifResponse - The fields the driver uses from a SOAP response
+ *
+ * parse() reads the reply with QXmlStreamReader, dispatches on the first
+ * element inside the SOAP Body and extracts only what that response type
+ * needs. Replies that carry no data (ContinuousMoveResponse, StopResponse,
+ * etc.) stop at the first body element and come back as Empty.
+ *
+ * Depends only on QtCore so it can be used from the worker pool and from the
+ * parser benchmark.
+ */
+class OnvifResponse {
+public:
+	enum Kind {
+		Empty,
+		SystemDateAndTime,
+		Capabilities,
+		Profiles,
+		Presets,
+		Status,
+		PullPointSubscription,
+		PullMessages,
+		Fault
+	};
+
+	Kind kind = Empty;
+	QDateTime utcTime;
+	QString ptzXAddr;
+	QString mediaXAddr;
+	QString eventsXAddr;
+	QList<MediaProfile> profiles;
+	QList<OnvifPreset> presets;
+	QString fault;
+	QString faultCode; /* Most specific subcode, without the namespace prefix */
+
+	/* GetStatus, in the generic position spaces */
+	bool hasPosition = false;
+	double pan = 0.0;
+	double tilt = 0.0;
+	double zoom = 0.0;
+	bool moving = false;
+
+	/* Events service */
+	QString subscriptionAddress;
+	QList<OnvifNotification> notifications;
+
+	static OnvifResponse parse(const QByteArray &xml);
+};
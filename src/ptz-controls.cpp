@@ -132,7 +132,7 @@ PTZControls::PTZControls(QWidget *parent) : QWidget(parent), ui(new Ui::PTZContr
 	QItemSelectionModel *selectionModel = ui->cameraList->selectionModel();
 	connect(selectionModel, SIGNAL(currentChanged(QModelIndex, QModelIndex)), this,
 		SLOT(currentChanged(QModelIndex, QModelIndex)));
-	connect(&accel_timer, &QTimer::timeout, this, &PTZControls::accelTimerHandler);
+	accel_timer.setCallback([this]() { accelTimerHandler(); });
 
 	connect(ui->panTiltTouch, SIGNAL(positionChanged(double, double)), this, SLOT(setPanTilt(double, double)));
 
@@ -140,6 +140,10 @@ PTZControls::PTZControls(QWidget *parent) : QWidget(parent), ui(new Ui::PTZContr
 
 	LoadConfig();
 
+	/* Periodically snapshot the camera state so it survives a crash */
+	state_save_timer.setCallback([]() { ptz_devices_save_state(); });
+	state_save_timer.start(60 * 1000);
+
 	auto filter = new squareResizeFilter(this);
 	ui->panTiltButton_upleft->installEventFilter(filter);
 	ui->panTiltButton_up->installEventFilter(filter);
@@ -268,6 +272,7 @@ PTZControls::~PTZControls()
 		obs_hotkey_unregister(hotkeys.takeFirst());
 
 	SaveConfig();
+	ptz_devices_save_state();
 	ptzDeviceList.delete_all();
 	deleteLater();
 }
@@ -16,6 +16,7 @@
 #endif
 #include "touch-control.hpp"
 #include "ptz-device.hpp"
+#include "timer-wheel.hpp"
 #include "ui_ptz-controls.h"
 
 class PTZControls : public QWidget {
@@ -43,7 +44,8 @@ private:
 	double zoom_accel = 0.0;
 	double focus_speed = 0.0;
 	double focus_accel = 0.0;
-	QTimer accel_timer;
+	PTZTimer accel_timer;
+	PTZTimer state_save_timer;
 
 	bool pantiltingFlag = false;
 	bool zoomingFlag = false;
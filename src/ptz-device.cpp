@@ -13,6 +13,8 @@
 #include "ptz-usb-cam.hpp"
 #include "ptz.h"
 #include "protocol-helpers.hpp"
+#include "timer-wheel.hpp"
+#include "io-thread.hpp"
 
 #if defined(ENABLE_SERIALPORT)
 #include "ptz-visca-uart.hpp"
@@ -21,6 +23,18 @@
 
 PTZListModel ptzDeviceList;
 QMap<uint32_t, PTZDevice *> PTZListModel::devices;
+QHash<QString, PTZDevice *> PTZListModel::device_names;
+
+/* Minimum spacing between connection or polling startup steps that share a
+ * transport. Keeps a large configuration from opening every connection and
+ * starting every inquiry sweep in the same instant */
+static const uint64_t bringup_interval_ns = 100 * 1000000ULL;
+/* Spacing between startup steps of all network devices together, so a room
+ * full of IP cameras doesn't resolve and connect in a single burst */
+static const uint64_t bringup_network_interval_ns = 25 * 1000000ULL;
+
+/* Last known camera state loaded from disk, keyed by device id */
+static OBSData state_cache;
 
 static void source_rename_cb(void *data, calldata_t *cd)
 {
@@ -39,6 +53,8 @@ PTZListModel::PTZListModel()
 {
 	signal_handler_t *sh = obs_get_signal_handler();
 	signal_handler_connect(sh, "source_rename", source_rename_cb, this);
+	statistics = obs_data_create();
+	obs_data_release(statistics);
 }
 
 PTZListModel::~PTZListModel()
@@ -78,17 +94,98 @@ QVariant PTZListModel::data(const QModelIndex &index, int role) const
 
 void PTZListModel::do_reset()
 {
+	if (batch_depth) {
+		reset_pending = true;
+		return;
+	}
 	beginResetModel();
 	endResetModel();
 }
 
-void PTZListModel::name_changed(PTZDevice *ptz)
+void PTZListModel::begin_batch()
+{
+	batch_depth++;
+}
+
+void PTZListModel::end_batch()
+{
+	if (--batch_depth > 0 || !reset_pending)
+		return;
+	reset_pending = false;
+	do_reset();
+}
+
+void PTZListModel::name_changed(PTZDevice *ptz, const QString &prev_name)
 {
+	if (devices.value(ptz->id) != ptz)
+		return;
+	if (device_names.value(prev_name) == ptz)
+		device_names.remove(prev_name);
+	device_names.insert(ptz->objectName(), ptz);
+
 	auto index = indexFromDeviceId(ptz->id);
 	if (index.isValid())
 		emit dataChanged(index, index);
 }
 
+/*
+ * Run a connection or polling startup step for a device. Steps contending for
+ * the same resource (a serial port, a shared UDP socket or a camera host) are
+ * spaced out by bringup_interval_ns, while steps on different resources
+ * proceed in parallel. Steps for network devices are additionally spaced by
+ * bringup_network_interval_ns across all resources. A step runs immediately
+ * when nothing else is queued, so interactive configuration changes are not
+ * delayed.
+ *
+ * Each device has at most one queued step. If another is requested for the
+ * same resource while one is waiting, the newer step replaces it in the
+ * existing slot. A request for a different resource takes a new slot there.
+ */
+void PTZListModel::bring_up(QObject *context, const QString &resource, std::function<void()> func, bool network)
+{
+	auto pending = bringup_pending.find(context);
+	if (pending != bringup_pending.end() && pending->resource == resource) {
+		pending->func = func;
+		return;
+	}
+
+	uint64_t now = os_gettime_ns();
+	uint64_t slot = std::max(now, bringup_slots.value(resource, 0));
+	if (network)
+		slot = std::max(slot, bringup_network_slot);
+	bringup_slots[resource] = slot + bringup_interval_ns;
+	if (network)
+		bringup_network_slot = slot + bringup_network_interval_ns;
+
+	if (slot == now) {
+		if (pending != bringup_pending.end()) {
+			disconnect(pending->destroyed);
+			bringup_pending.erase(pending);
+		}
+		func();
+		return;
+	}
+
+	PendingBringUp &entry = bringup_pending[context];
+	if (!entry.destroyed)
+		entry.destroyed = connect(context, &QObject::destroyed, this,
+					  [this, context]() { bringup_pending.remove(context); });
+	entry.resource = resource;
+	entry.func = func;
+	/* A timer still queued for a previous slot finds the ticket changed */
+	uint64_t ticket = ++entry.ticket;
+	QTimer::singleShot((int)((slot - now) / 1000000), context, [this, context, ticket]() {
+		auto it = bringup_pending.find(context);
+		if (it == bringup_pending.end() || it->ticket != ticket)
+			return;
+		PendingBringUp entry = std::move(*it);
+		bringup_pending.erase(it);
+		disconnect(entry.destroyed);
+		if (entry.func)
+			entry.func();
+	});
+}
+
 PTZDevice *PTZListModel::getDevice(const QModelIndex &index) const
 {
 	if (index.row() < 0)
@@ -110,12 +207,12 @@ PTZDevice *PTZListModel::getDevice(uint32_t device_id) const
 
 PTZDevice *PTZListModel::getDeviceByName(const QString &name) const
 {
-	for (auto key : devices.keys()) {
-		auto ptz = devices.value(key);
-		if (name == ptz->objectName())
-			return ptz;
-	}
-	return NULL;
+	return device_names.value(name, nullptr);
+}
+
+QList<uint32_t> PTZListModel::getDeviceIds() const
+{
+	return devices.keys();
 }
 
 QStringList PTZListModel::getDeviceNames() const
@@ -153,6 +250,7 @@ void PTZListModel::add(PTZDevice *ptz)
 			ptz->id++;
 	}
 	devices.insert(ptz->id, ptz);
+	device_names.insert(ptz->objectName(), ptz);
 	do_reset();
 }
 
@@ -160,6 +258,8 @@ void PTZListModel::remove(PTZDevice *ptz)
 {
 	if (ptz == devices.value(ptz->id)) {
 		devices.remove(ptz->id);
+		if (device_names.value(ptz->objectName()) == ptz)
+			device_names.remove(ptz->objectName());
 		do_reset();
 	}
 }
@@ -242,6 +342,13 @@ PTZDevice *PTZListModel::make_device(OBSData config)
 	if (type == "usb-cam")
 		ptz = new PTZUSBCam(config);
 #endif /* ENABLE_USB_CAM */
+
+	/* Restored after construction, once the driver has set snapshot_keys */
+	if (ptz && state_cache) {
+		OBSDataAutoRelease state = obs_data_get_obj(state_cache, QT_TO_UTF8(QString::number(ptz->id)));
+		if (state)
+			ptz->load_state(state.Get());
+	}
 	return ptz;
 }
 
@@ -259,6 +366,69 @@ void PTZListModel::preset_recall(uint32_t device_id, int preset_id)
 		ptz->memory_recall(preset_id);
 }
 
+/*
+ * Group dispatch. Commands for every device are encoded first and the
+ * resulting frames are released to the transports in one burst. A driver that
+ * can't send straight away (a VISCA camera waiting on an inquiry reply, an
+ * ONVIF camera at its request limit, a Pelco bus still busy with the previous
+ * frame, or a USB camera) sends later on its own. Those devices are logged and
+ * counted as missed for the group call.
+ */
+void PTZListModel::group_dispatch(const QList<uint32_t> &device_ids, std::function<void(uint32_t)> func)
+{
+	QStringList missed;
+	int count = 0;
+	PTZIOBurst burst;
+	for (auto id : device_ids) {
+		PTZDevice *ptz = getDevice(id);
+		if (!ptz)
+			continue;
+		uint64_t queued = PTZIOBurst::queuedCount();
+		func(id);
+		count++;
+		if (PTZIOBurst::queuedCount() == queued)
+			missed += ptz->objectName();
+	}
+	if (!count)
+		return;
+
+	PTZIOBurst::onReleased([this, count, missed](size_t transports, uint64_t spread_ns) {
+		obs_data_set_int(statistics, "group_call_count", obs_data_get_int(statistics, "group_call_count") + 1);
+		obs_data_set_int(statistics, "group_last_devices", count);
+		obs_data_set_int(statistics, "group_last_missed", missed.size());
+		obs_data_set_int(statistics, "group_last_transports", transports);
+		obs_data_set_double(statistics, "group_last_spread_ms", spread_ns / 1000000.0);
+		double max_ms = std::max(obs_data_get_double(statistics, "group_spread_max_ms"), spread_ns / 1000000.0);
+		obs_data_set_double(statistics, "group_spread_max_ms", max_ms);
+		if (missed.isEmpty())
+			blog(LOG_DEBUG, "PTZ group command to %i devices, spread %.3f ms", count, spread_ns / 1000000.0);
+		else
+			blog(LOG_INFO, "PTZ group command to %i devices, spread %.3f ms, not synchronized: %s", count,
+			     spread_ns / 1000000.0, QT_TO_UTF8(missed.join(", ")));
+	});
+}
+
+void PTZListModel::group_preset_recall(QList<uint32_t> device_ids, int preset_id)
+{
+	group_dispatch(device_ids, [this, preset_id](uint32_t id) { preset_recall(id, preset_id); });
+}
+
+void PTZListModel::group_move_continuous(QList<uint32_t> device_ids, uint32_t flags, double pan, double tilt,
+					 double zoom, double focus)
+{
+	group_dispatch(device_ids, [this, flags, pan, tilt, zoom, focus](uint32_t id) {
+		move_continuous(id, flags, pan, tilt, zoom, focus);
+	});
+}
+
+/* Statistics that belong to the plugin as a whole rather than a device */
+OBSData PTZListModel::get_statistics()
+{
+	PTZTimerWheel::instance()->writeStatistics(statistics);
+	PTZWorkerPool::writeStatistics(statistics);
+	return statistics;
+}
+
 void PTZListModel::preset_save(uint32_t device_id, int preset_id)
 {
 	PTZDevice *ptz = ptzDeviceList.getDevice(device_id);
@@ -454,6 +624,8 @@ PTZDevice::PTZDevice(OBSData config) : QObject()
 
 PTZDevice::~PTZDevice()
 {
+	if (strand)
+		strand->close();
 	ptzDeviceList.remove(this);
 }
 
@@ -474,8 +646,9 @@ void PTZDevice::setObjectName(QString name)
 			break;
 		new_name = name + " " + QString::number(i);
 	}
+	QString prev_name = objectName();
 	QObject::setObjectName(new_name);
-	ptzDeviceList.name_changed(this);
+	ptzDeviceList.name_changed(this, prev_name);
 }
 
 QString PTZDevice::description()
@@ -564,6 +737,75 @@ OBSData PTZDevice::get_config()
 	return config;
 }
 
+/* Copy the listed items that have a value from src to dst */
+static void copy_snapshot_items(obs_data_t *dst, obs_data_t *src, const QStringList &keys)
+{
+	for (const auto &key : keys) {
+		QByteArray utf8 = key.toUtf8();
+		const char *name = utf8.constData();
+		OBSDataItemAutoRelease item = obs_data_item_byname(src, name);
+		if (!item || !obs_data_item_has_user_value(item))
+			continue;
+		switch (obs_data_item_gettype(item)) {
+		case OBS_DATA_NUMBER:
+			if (obs_data_item_numtype(item) == OBS_DATA_NUM_INT)
+				obs_data_set_int(dst, name, obs_data_item_get_int(item));
+			else
+				obs_data_set_double(dst, name, obs_data_item_get_double(item));
+			break;
+		case OBS_DATA_BOOLEAN:
+			obs_data_set_bool(dst, name, obs_data_item_get_bool(item));
+			break;
+		case OBS_DATA_STRING:
+			obs_data_set_string(dst, name, obs_data_item_get_string(item));
+			break;
+		default:
+			break;
+		}
+	}
+}
+
+OBSData PTZDevice::get_state()
+{
+	OBSData state = obs_data_create();
+	obs_data_release(state);
+	copy_snapshot_items(state, settings, snapshot_keys);
+	return state;
+}
+
+/* Values in the snapshot that this driver never reads back are ignored; they
+ * could not be confirmed and would leave the device unverified */
+void PTZDevice::load_state(OBSData state)
+{
+	copy_snapshot_items(settings, state, snapshot_keys);
+	markUnverified();
+}
+
+/* Mark all snapshot values currently held in settings as needing
+ * confirmation from the camera */
+void PTZDevice::markUnverified()
+{
+	unverified_settings.clear();
+	for (const auto &key : snapshot_keys) {
+		if (obs_data_has_user_value(settings, QT_TO_UTF8(key)))
+			unverified_settings += key;
+	}
+	obs_data_set_bool(settings, "state_unverified", !unverified_settings.isEmpty());
+}
+
+/* Called with freshly received values from the camera */
+void PTZDevice::markVerified(obs_data_t *data)
+{
+	if (unverified_settings.isEmpty())
+		return;
+	for (auto item = obs_data_first(data); item; obs_data_item_next(&item))
+		unverified_settings -= obs_data_item_get_name(item);
+	if (unverified_settings.isEmpty()) {
+		obs_data_set_bool(settings, "state_unverified", false);
+		obs_data_set_bool(data, "state_unverified", false);
+	}
+}
+
 void PTZDevice::set_settings(OBSData config)
 {
 	if (obs_data_has_user_value(config, "name"))
@@ -644,15 +886,71 @@ void ptz_devices_set_config(obs_data_array_t *devices)
 		blog(LOG_INFO, "No PTZ device configuration found");
 		return;
 	}
+
+	/* Load the last known camera state so that it can be displayed
+	 * before the cameras respond to inquiries */
+	char *file = obs_module_config_path("state.json");
+	if (file) {
+		OBSDataAutoRelease loaddata = obs_data_create_from_json_file_safe(file, "bak");
+		bfree(file);
+		if (loaddata) {
+			OBSDataAutoRelease cache = obs_data_get_obj(loaddata, "devices");
+			state_cache = cache.Get();
+		}
+	}
+
+	/* Populate the model with a single reset for the whole config */
+	ptzDeviceList.begin_batch();
 	for (size_t i = 0; i < obs_data_array_count(devices); i++) {
 		OBSData ptzcfg = obs_data_array_item(devices, i);
 		obs_data_release(ptzcfg);
 		ptzDeviceList.make_device(ptzcfg);
 	}
+	ptzDeviceList.end_batch();
+	state_cache = nullptr;
+}
+
+void ptz_devices_save_state()
+{
+	char *file = obs_module_config_path("state.json");
+	if (!file)
+		return;
+
+	OBSDataAutoRelease savedata = obs_data_create();
+	OBSDataAutoRelease device_states = obs_data_create();
+	for (auto key : ptzDeviceList.getDeviceIds()) {
+		OBSData state = ptzDeviceList.getDevice(key)->get_state();
+		obs_data_set_obj(device_states, QT_TO_UTF8(QString::number(key)), state);
+	}
+	obs_data_set_obj(savedata, "devices", device_states);
+
+	if (!obs_data_save_json_safe(savedata, file, "tmp", "bak")) {
+		char *path = obs_module_config_path("");
+		if (path) {
+			os_mkdirs(path);
+			bfree(path);
+		}
+		obs_data_save_json_safe(savedata, file, "tmp", "bak");
+	}
+	bfree(file);
 }
 
 static proc_handler_t *ptz_ph = NULL;
 
+/* Group commands take a comma separated list of device ids */
+static QList<uint32_t> parse_device_ids(calldata_t *cd)
+{
+	QList<uint32_t> ids;
+	const char *str = calldata_string(cd, "device_ids");
+	for (auto s : QString(str).split(',', Qt::SkipEmptyParts)) {
+		bool ok;
+		uint32_t id = s.trimmed().toUInt(&ok);
+		if (ok)
+			ids.append(id);
+	}
+	return ids;
+}
+
 proc_handler_t *ptz_get_proc_handler()
 {
 	return ptz_ph;
@@ -697,6 +995,36 @@ void ptz_load_devices()
 			 "void ptz_move_continuous(int device_id, float pan, float tilt, float zoom, float focus)",
 			 ptz_move_continuous, NULL);
 
+	/* Group commands, released to all cameras in a single burst */
+	auto ptz_group_preset_recall = [](void *data, calldata_t *cd) {
+		Q_UNUSED(data);
+		auto ids = parse_device_ids(cd);
+		int preset_id = (int)calldata_int(cd, "preset_id");
+		QMetaObject::invokeMethod(&ptzDeviceList,
+					  [ids, preset_id]() { ptzDeviceList.group_preset_recall(ids, preset_id); });
+	};
+	proc_handler_add(ptz_ph, "void ptz_group_preset_recall(string device_ids, int preset_id)",
+			 ptz_group_preset_recall, NULL);
+
+	auto ptz_group_move_continuous = [](void *data, calldata_t *cd) {
+		Q_UNUSED(data);
+		auto ids = parse_device_ids(cd);
+		double pan = 0, tilt = 0, zoom = 0, focus = 0;
+		uint32_t flags = 0;
+		if (calldata_get_float(cd, "pan", &pan) && calldata_get_float(cd, "tilt", &tilt))
+			flags |= MOVE_FLAG_PANTILT;
+		if (calldata_get_float(cd, "zoom", &zoom))
+			flags |= MOVE_FLAG_ZOOM;
+		if (calldata_get_float(cd, "focus", &focus))
+			flags |= MOVE_FLAG_FOCUS;
+		QMetaObject::invokeMethod(&ptzDeviceList, [=]() {
+			ptzDeviceList.group_move_continuous(ids, flags, pan, tilt, zoom, focus);
+		});
+	};
+	proc_handler_add(ptz_ph,
+			 "void ptz_group_move_continuous(string device_ids, float pan, float tilt, float zoom, float focus)",
+			 ptz_group_move_continuous, NULL);
+
 	/* Register the new proc hander with the main proc handler */
 	proc_handler_t *ph = obs_get_proc_handler();
 	if (!ph)
@@ -718,6 +1046,8 @@ void ptz_unload_devices(void)
 {
 	proc_handler_destroy(ptz_ph);
 	ptz_ph = nullptr;
+	ptz_io_thread_stop();
+	PTZWorkerPool::shutdown();
 }
 
 void PTZDevice::incrementStatistic(const char *name)
@@ -8,6 +8,7 @@
 
 #include "ptz.h"
 #include <qt-wrappers.hpp>
+#include <functional>
 #include <memory>
 #include <QObject>
 #include <QSet>
@@ -16,6 +17,7 @@
 #include <obs.hpp>
 #include <obs-frontend-api.h>
 #include <util/platform.h>
+#include "worker-pool.hpp"
 
 #define ptz_log(level, format, ...) \
 	blog(level, "[%s/%.12s] " format, type.c_str(), QT_TO_UTF8(objectName()), ##__VA_ARGS__)
@@ -32,6 +34,28 @@ class PTZListModel : public QAbstractListModel {
 
 private:
 	static QMap<uint32_t, PTZDevice *> devices;
+	static QHash<QString, PTZDevice *> device_names;
+
+	/* Model resets are deferred while a batch of devices is added */
+	int batch_depth = 0;
+	bool reset_pending = false;
+
+	/* Earliest time (in ns) the next bring-up step may run per resource,
+	 * and for any network device */
+	QHash<QString, uint64_t> bringup_slots;
+	uint64_t bringup_network_slot = 0;
+	/* Queued bring-up step per device; a newer request replaces it */
+	struct PendingBringUp {
+		QString resource;
+		std::function<void()> func;
+		uint64_t ticket = 0;
+		QMetaObject::Connection destroyed;
+	};
+	QHash<QObject *, PendingBringUp> bringup_pending;
+
+	/* Plugin wide statistics, not tied to any one device */
+	OBSData statistics;
+	void group_dispatch(const QList<uint32_t> &device_ids, std::function<void(uint32_t)> func);
 
 public:
 	PTZListModel();
@@ -39,7 +63,11 @@ public:
 	int rowCount(const QModelIndex &parent = QModelIndex()) const;
 	QVariant data(const QModelIndex &index, int role) const;
 	void do_reset();
-	void name_changed(PTZDevice *ptz);
+	void begin_batch();
+	void end_batch();
+	void name_changed(PTZDevice *ptz, const QString &prev_name);
+	void bring_up(QObject *context, const QString &resource, std::function<void()> func, bool network = false);
+	OBSData get_statistics();
 	Qt::ItemFlags flags(const QModelIndex &index) const;
 
 	/* Data Model */
@@ -48,6 +76,7 @@ public:
 	uint32_t getDeviceId(const QModelIndex &index) const;
 	PTZDevice *getDevice(uint32_t device_id) const;
 	PTZDevice *getDeviceByName(const QString &name) const;
+	QList<uint32_t> getDeviceIds() const;
 	QStringList getDeviceNames() const;
 	QModelIndex indexFromDeviceId(uint32_t device_id);
 	void renameDevice(QString new_name, QString prev_name);
@@ -59,6 +88,9 @@ public:
 public slots:
 	void preset_recall(uint32_t device_id, int preset_id);
 	void preset_save(uint32_t device_id, int preset_id);
+	void group_preset_recall(QList<uint32_t> device_ids, int preset_id);
+	void group_move_continuous(QList<uint32_t> device_ids, uint32_t flags, double pan, double tilt, double zoom,
+				   double focus);
 	void move_continuous(uint32_t device_id, uint32_t flags, double pan, double tilt, double zoom, double focus);
 };
 
@@ -129,7 +161,22 @@ protected:
 	OBSData settings;
 	OBSData statistics;
 	QSet<QString> stale_settings;
+	/* Settings saved in the state snapshot. Each driver lists only the
+	 * values its inquiries read back, so a restored snapshot is always
+	 * fully confirmed once the camera has answered */
+	QStringList snapshot_keys;
+	/* Settings restored from the state snapshot that the camera has not
+	 * confirmed yet. Cleared as fresh inquiry results arrive */
+	QSet<QString> unverified_settings;
+	/* Serialized queue on the worker pool for blocking or heavy protocol
+	 * work. Results are handed back to the main thread with a queued
+	 * invocation on the device object. Only created by drivers that have
+	 * such work (ONVIF parsing, USB camera controls); the others run
+	 * entirely on the main thread */
+	std::shared_ptr<PTZStrand> strand;
 	void incrementStatistic(const char *name);
+	void markUnverified();
+	void markVerified(obs_data_t *data);
 
 signals:
 	void settingsChanged(OBSData settings);
@@ -213,6 +260,13 @@ public:
 	virtual void set_settings(OBSData setting);
 	virtual OBSData get_settings();
 
+	/* The state snapshot is the subset of `settings` describing the
+	 * physical camera state (positions, focus, exposure, white balance).
+	 * It is saved to disk so that it can be shown immediately on the next
+	 * start, before the camera has answered any inquiries */
+	OBSData get_state();
+	void load_state(OBSData state);
+
 	/* Properties describe how to display the settings in a GUI dialog */
 	virtual obs_properties_t *get_obs_properties();
 };
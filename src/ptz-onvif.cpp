@@ -9,26 +9,114 @@
  * requires manually adding an ONVIF entry to the config file.
  */
 
+#include <algorithm>
 #include <qt-wrappers.hpp>
 #include "ptz-onvif.hpp"
-#include <QtXml/QDomDocument>
-#include <QXmlStreamWriter>
+#include "io-thread.hpp"
+#include <QCryptographicHash>
+#include <QRegularExpression>
+
+/*
+ * Each camera has its own QNetworkAccessManager, so requests to it share a
+ * pool of kept-alive HTTP/1.1 connections. At most max_in_flight requests
+ * are outstanding at once; the rest wait in m_pending in order.
+ */
+void PTZOnvif::sendRequest(QString url, const QByteArray &req, RequestClass cls)
+{
+	m_pending.append({url, req, false, cls});
+	pumpRequests();
+}
 
-void PTZOnvif::sendRequest(QString url, QString req)
+void PTZOnvif::pumpRequests()
 {
-	QNetworkRequest request(url);
-	request.setHeader(QNetworkRequest::ContentTypeHeader, "application/soap+xml");
-	QString concatenated = username + ":" + password;
-	QByteArray data = concatenated.toLocal8Bit().toBase64();
-	QString headerData = "Basic " + data;
-	request.setRawHeader("Authorization", headerData.toLocal8Bit());
-	m_networkManager.post(request, req.toUtf8());
+	while (m_inFlight < max_in_flight && !m_pending.isEmpty())
+		postRequest(m_pending.takeFirst());
+	obs_data_set_int(statistics, "onvif_queued", m_pending.size());
 }
 
-void PTZOnvif::authRequired(QNetworkReply *, QAuthenticator *authenticator)
+/* Inside a group command burst the post itself is held back, so it is handed
+ * to the network stack together with the other cameras' commands */
+void PTZOnvif::postRequest(const PendingRequest &pending)
 {
-	authenticator->setUser(username);
-	authenticator->setPassword(password);
+	QNetworkRequest request(pending.url);
+	request.setHeader(QNetworkRequest::ContentTypeHeader, "application/soap+xml");
+	request.setRawHeader("Connection", "keep-alive");
+	request.setRawHeader("Authorization", authorization(request.url()));
+
+	m_inFlight++;
+	PTZIOBurst::defer([this, request, pending]() {
+		QNetworkReply *reply = m_networkManager.post(request, pending.body);
+		reply->setProperty("onvif_start_ns", (qulonglong)os_gettime_ns());
+		reply->setProperty("onvif_body", pending.body);
+		reply->setProperty("onvif_retried", pending.retried);
+		reply->setProperty("onvif_class", (int)pending.cls);
+	});
+}
+
+/*
+ * Digest challenges are cached, so once the first 401 has been answered every
+ * later request carries a precomputed Digest response and completes in a
+ * single round trip. Until a challenge is seen Basic credentials are sent.
+ */
+QByteArray PTZOnvif::authorization(const QUrl &url)
+{
+	if (m_digestNonce.isEmpty())
+		return "Basic " + (username + ":" + password).toLocal8Bit().toBase64();
+
+	auto md5 = [](const QByteArray &data) {
+		return QCryptographicHash::hash(data, QCryptographicHash::Md5).toHex();
+	};
+	QByteArray uri = url.path(QUrl::FullyEncoded).toUtf8();
+	if (uri.isEmpty())
+		uri = "/";
+	QByteArray ha1 = md5(username.toUtf8() + ":" + m_digestRealm + ":" + password.toUtf8());
+	QByteArray ha2 = md5("POST:" + uri);
+	QByteArray header = "Digest username=\"" + username.toUtf8() + "\", realm=\"" + m_digestRealm +
+			    "\", nonce=\"" + m_digestNonce + "\", uri=\"" + uri + "\", algorithm=MD5";
+	if (m_digestQopAuth) {
+		QByteArray nc = QByteArray::number(++m_digestCount, 16).rightJustified(8, '0');
+		QByteArray cnonce = QUuid::createUuid().toByteArray(QUuid::Id128);
+		header += ", qop=auth, nc=" + nc + ", cnonce=\"" + cnonce + "\", response=\"" +
+			  md5(ha1 + ":" + m_digestNonce + ":" + nc + ":" + cnonce + ":auth:" + ha2) + "\"";
+	} else {
+		header += ", response=\"" + md5(ha1 + ":" + m_digestNonce + ":" + ha2) + "\"";
+	}
+	if (!m_digestOpaque.isEmpty())
+		header += ", opaque=\"" + m_digestOpaque + "\"";
+	return header;
+}
+
+/* Returns true if a usable Digest challenge was found in the reply */
+bool PTZOnvif::cacheDigestChallenge(QNetworkReply *reply)
+{
+	QByteArray challenge = reply->rawHeader("WWW-Authenticate");
+	if (!challenge.startsWith("Digest "))
+		return false;
+
+	static const QRegularExpression re("(\\w+)=(?:\"([^\"]*)\"|([^,\\s]*))");
+	QString nonce, realm, opaque, qop;
+	auto it = re.globalMatch(QString::fromUtf8(challenge.mid(7)));
+	while (it.hasNext()) {
+		auto m = it.next();
+		QString key = m.captured(1).toLower();
+		QString value = m.captured(2).isNull() ? m.captured(3) : m.captured(2);
+		if (key == "nonce")
+			nonce = value;
+		else if (key == "realm")
+			realm = value;
+		else if (key == "opaque")
+			opaque = value;
+		else if (key == "qop")
+			qop = value;
+	}
+	if (nonce.isEmpty())
+		return false;
+	m_digestNonce = nonce.toUtf8();
+	m_digestRealm = realm.toUtf8();
+	m_digestOpaque = opaque.toUtf8();
+	m_digestQopAuth = qop.split(',').contains("auth");
+	m_digestCount = 0;
+	return true;
 }
 
 const QString nsXmlSchema("http://www.w3.org/2001/XMLSchema");                  //xsd
@@ -40,101 +128,165 @@ const QString nsOnvifSchema("http://www.onvif.org/ver10/schema");
 const QString nsOnvifDevice("http://www.onvif.org/ver10/device/wsdl");          //tds
 const QString nsOnvifMedia("http://www.onvif.org/ver10/media/wsdl");            //trt
 const QString nsOnvifPtz("http://www.onvif.org/ver20/ptz/wsdl");                //tptz
+const QString nsOnvifEvents("http://www.onvif.org/ver10/events/wsdl");          //tev
+const QString nsWsnBase("http://docs.oasis-open.org/wsn/b-2");                  //wsnt
 const QString nsWssSecext("http://docs.oasis-open.org/wss/2004/01/oasis-200401-wss-wssecurity-secext-1.0.xsd");   //wsse
 const QString nsWssUtility("http://docs.oasis-open.org/wss/2004/01/oasis-200401-wss-wssecurity-utility-1.0.xsd"); //wsu
 const QString nsWssPasswordDigest(
 	"http://docs.oasis-open.org/wss/2004/01/oasis-200401-wss-username-token-profile-1.0#PasswordDigest");
 
-static void writeStartOnvifDocument(QXmlStreamWriter &s)
-{
-	s.setAutoFormatting(true);
-	s.setAutoFormattingIndent(1);
-	s.writeStartDocument();
-	s.writeNamespace(nsSoapEnvelope, "SOAP-ENV");
-	s.writeNamespace(nsSoapEncoding, "SOAP-ENC");
-	s.writeNamespace(nsAddressing, "wsa5");
-	s.writeNamespace(nsXmlSchemaInstance, "xsi");
-	s.writeNamespace(nsXmlSchema, "xsd");
-	s.writeNamespace(nsOnvifSchema, "tt");
-	s.writeNamespace(nsOnvifDevice, "tds");
-	s.writeNamespace(nsOnvifMedia, "trt");
-	s.writeNamespace(nsOnvifPtz, "tptz");
-	s.writeNamespace(nsWssSecext, "wsse");
-	s.writeNamespace(nsWssUtility, "wsu");
-}
-
-void PTZOnvif::writeHeader(QXmlStreamWriter &s, const QString action = "")
+/*
+ * SOAP requests are assembled from precompiled fragments rather than with
+ * QXmlStreamWriter. The envelope, with all of its namespace declarations, is
+ * built once; each request only formats its variable parts (action, security
+ * token and body values) into a buffer that is reused between requests.
+ */
+static const QByteArray &envelopeStart()
+{
+	static const QByteArray start = [] {
+		QByteArray s = "<?xml version=\"1.0\" encoding=\"UTF-8\"?><SOAP-ENV:Envelope";
+		const std::pair<const QString &, const char *> namespaces[] = {
+			{nsSoapEnvelope, "SOAP-ENV"}, {nsSoapEncoding, "SOAP-ENC"}, {nsAddressing, "wsa5"},
+			{nsXmlSchemaInstance, "xsi"}, {nsXmlSchema, "xsd"},        {nsOnvifSchema, "tt"},
+			{nsOnvifDevice, "tds"},       {nsOnvifMedia, "trt"},       {nsOnvifPtz, "tptz"},
+			{nsOnvifEvents, "tev"},       {nsWsnBase, "wsnt"},         {nsWssSecext, "wsse"},
+			{nsWssUtility, "wsu"},
+		};
+		for (auto &ns : namespaces)
+			s += QByteArray(" xmlns:") + ns.second + "=\"" + ns.first.toUtf8() + "\"";
+		s += "><SOAP-ENV:Header>";
+		return s;
+	}();
+	return start;
+}
+
+static const QByteArray ptzActionPrefix = "<wsa5:Action SOAP-ENV:mustUnderstand=\"1\">" + nsOnvifPtz.toUtf8() + "/";
+static const QByteArray eventActionPrefix = "<wsa5:Action SOAP-ENV:mustUnderstand=\"1\">" + nsOnvifEvents.toUtf8() + "/";
+/* Renew and Unsubscribe are WS-BaseNotification operations, not ONVIF ones */
+static const QByteArray wsnActionPrefix =
+	"<wsa5:Action SOAP-ENV:mustUnderstand=\"1\">http://docs.oasis-open.org/wsn/bw-2/";
+static const QByteArray securityStart = "<wsse:Security SOAP-ENV:mustUnderstand=\"1\"><wsse:UsernameToken><wsse:Username>";
+static const QByteArray passwordStart = "</wsse:Username><wsse:Password Type=\"" + nsWssPasswordDigest.toUtf8() + "\">";
+static const QByteArray nonceStart = "</wsse:Password><wsse:Nonce EncodingType=\"" + nsWssPasswordDigest.toUtf8() + "\">";
+static const QByteArray securityEnd = "</wsu:Created></wsse:UsernameToken></wsse:Security>";
+static const QByteArray headerEnd = "</SOAP-ENV:Header><SOAP-ENV:Body>";
+static const QByteArray envelopeEnd = "</SOAP-ENV:Body></SOAP-ENV:Envelope>";
+
+static QByteArray escaped(const QString &text)
+{
+	return text.toHtmlEscaped().toUtf8();
+}
+
+/*
+ * The UsernameToken (nonce, creation time and password digest) is reused for
+ * token_lifetime_ms instead of being regenerated for every request, which
+ * matters during continuous moves. The creation time is corrected by the
+ * camera's clock offset so tokens aren't rejected for being stale.
+ */
+static void appendUsernameToken(QByteArray &s, const QString &username, const QString &password,
+				qint64 clock_offset_ms)
 {
 	QUuid nonce = QUuid::createUuid();
-	QString nonce64 = nonce.toByteArray().toBase64();
-	auto timestamp = QDateTime::currentDateTimeUtc().toString(Qt::ISODate);
-	auto token = nonce.toString() + timestamp + password;
+	QString timestamp = QDateTime::currentDateTimeUtc().addMSecs(clock_offset_ms).toString(Qt::ISODate);
 	QCryptographicHash hash(QCryptographicHash::Sha1);
-	hash.addData(token.toUtf8());
-	QString hashTokenBase64 = hash.result().toBase64();
-
-	s.writeStartElement(nsSoapEnvelope, "Header");
-	if (action != "") {
-		s.writeStartElement(nsAddressing, "Action");
-		s.writeAttribute(nsSoapEnvelope, "mustUnderstand", "1");
-		s.writeCharacters(action);
-		s.writeEndElement(); // Action
+	hash.addData((nonce.toString() + timestamp + password).toUtf8());
+
+	s += securityStart;
+	s += escaped(username);
+	s += passwordStart;
+	s += hash.result().toBase64();
+	s += nonceStart;
+	s += nonce.toByteArray().toBase64();
+	s += "</wsse:Nonce><wsu:Created>";
+	s += timestamp.toUtf8();
+	s += securityEnd;
+}
+
+const QByteArray &PTZOnvif::securityHeader()
+{
+	uint64_t now = os_gettime_ns();
+	if (!m_securityHeader.isEmpty() && now - m_securityHeaderNs < token_lifetime_ms * 1000000ULL)
+		return m_securityHeader;
+
+	m_securityHeader.resize(0);
+	appendUsernameToken(m_securityHeader, username, password, m_clockOffsetMs);
+	m_securityHeaderNs = now;
+	incrementStatistic("onvif_token_count");
+	return m_securityHeader;
+}
+
+/* Complete request with a fresh token, for use outside of a device */
+QByteArray PTZOnvif::buildRequest(const QString &username, const QString &password, const QByteArray &body)
+{
+	QByteArray s = envelopeStart();
+	appendUsernameToken(s, username, password, 0);
+	s += headerEnd;
+	s += body;
+	s += envelopeEnd;
+	return s;
+}
+
+/* Start a request in the reusable buffer, up to and including <Body>. PTZ
+ * service requests carry a WS-Addressing action */
+QByteArray &PTZOnvif::beginRequest(const char *ptz_action)
+{
+	QByteArray &s = m_request;
+	s.resize(0);
+	s += envelopeStart();
+	if (ptz_action) {
+		s += ptzActionPrefix;
+		s += ptz_action;
+		s += "</wsa5:Action>";
 	}
-	s.writeStartElement(nsWssSecext, "Security");
-	s.writeAttribute(nsSoapEnvelope, "mustUnderstand", "1");
-	s.writeStartElement(nsWssSecext, "UsernameToken");
-	s.writeTextElement(nsWssSecext, "Username", username);
-	s.writeStartElement(nsWssSecext, "Password");
-	s.writeAttribute("Type", nsWssPasswordDigest);
-	s.writeCharacters(hashTokenBase64);
-	s.writeEndElement(); // Password
-	s.writeStartElement(nsWssSecext, "Nonce");
-	s.writeAttribute("EncodingType", nsWssPasswordDigest);
-	s.writeCharacters(nonce64);
-	s.writeEndElement(); // Nonce
-	s.writeTextElement(nsWssUtility, "Created", timestamp);
-	s.writeEndElement(); // UsernameToken
-	s.writeEndElement(); // Security
-	s.writeEndElement(); // Header
-}
-
-static void writePanTilt(QXmlStreamWriter &s, double pan, double tilt)
-{
-	s.writeEmptyElement(nsOnvifSchema, "PanTilt");
-	s.writeAttribute("x", QString::number(pan));
-	s.writeAttribute("y", QString::number(tilt));
-}
-
-static void writeZoom(QXmlStreamWriter &s, double zoom)
-{
-	s.writeEmptyElement(nsOnvifSchema, "Zoom");
-	s.writeAttribute("x", QString::number(zoom));
-}
-
-void PTZOnvif::genericMove(QString movetype, QString property, double x, double y, double z)
-{
-	QString msg;
-	QXmlStreamWriter s(&msg);
-	writeStartOnvifDocument(s);
-	s.writeStartElement(nsSoapEnvelope, "Envelope");
-	writeHeader(s, nsOnvifPtz + "/" + movetype);
-	s.writeStartElement(nsSoapEnvelope, "Body");
-	s.writeStartElement(nsOnvifPtz, movetype);
-	s.writeTextElement(nsOnvifPtz, "ProfileToken", m_selectedMedia.token);
-	s.writeStartElement(nsOnvifPtz, property);
-	writePanTilt(s, x, y);
-	writeZoom(s, z);
-	s.writeEndElement(); // property
-	s.writeEndElement(); // movetype
-	s.writeEndElement(); // Body
-	s.writeEndElement(); // Envelope
-	s.writeEndDocument();
-	sendRequest(m_PTZAddress, msg);
+	s += securityHeader();
+	s += headerEnd;
+	return s;
+}
+
+void PTZOnvif::finishRequest(const QString &url, RequestClass cls)
+{
+	m_request += envelopeEnd;
+	sendRequest(url, m_request, cls);
+}
+
+static void appendTextElement(QByteArray &s, const char *tag, const QString &text)
+{
+	s += '<';
+	s += tag;
+	s += '>';
+	s += escaped(text);
+	s += "</";
+	s += tag;
+	s += '>';
+}
+
+void PTZOnvif::genericMove(const char *movetype, const char *property, double x, double y, double z,
+			   RequestClass cls)
+{
+	QByteArray &s = beginRequest(movetype);
+	s += "<tptz:";
+	s += movetype;
+	s += '>';
+	appendTextElement(s, "tptz:ProfileToken", m_selectedMedia.token);
+	s += "<tptz:";
+	s += property;
+	s += "><tt:PanTilt x=\"";
+	s += QByteArray::number(x);
+	s += "\" y=\"";
+	s += QByteArray::number(y);
+	s += "\"/><tt:Zoom x=\"";
+	s += QByteArray::number(z);
+	s += "\"/></tptz:";
+	s += property;
+	s += "></tptz:";
+	s += movetype;
+	s += '>';
+	finishRequest(m_PTZAddress, cls);
 }
 
 void PTZOnvif::continuousMove(double x, double y, double z)
 {
-	genericMove("ContinuousMove", "Velocity", x, y, z);
+	genericMove("ContinuousMove", "Velocity", x, y, z, RequestMotion);
 }
 
 void PTZOnvif::absoluteMove(int x, int y, int z)
@@ -149,61 +301,35 @@ void PTZOnvif::relativeMove(int x, int y, int z)
 
 void PTZOnvif::stop()
 {
-	QString msg;
-	QXmlStreamWriter s(&msg);
-	writeStartOnvifDocument(s);
-	s.writeStartElement(nsSoapEnvelope, "Envelope");
-	writeHeader(s, nsOnvifPtz + "/" + "Stop");
-	s.writeStartElement(nsSoapEnvelope, "Body");
-	s.writeStartElement(nsOnvifPtz, "Stop");
-	s.writeTextElement(nsOnvifPtz, "ProfileToken", m_selectedMedia.token);
-	s.writeTextElement(nsOnvifPtz, "PanTilt", "true");
-	s.writeTextElement(nsOnvifPtz, "Zoom", "true");
-	s.writeEndElement(); // movetype
-	s.writeEndElement(); // Body
-	s.writeEndElement(); // Envelope
-	s.writeEndDocument();
-	sendRequest(m_PTZAddress, msg);
+	QByteArray &s = beginRequest("Stop");
+	s += "<tptz:Stop>";
+	appendTextElement(s, "tptz:ProfileToken", m_selectedMedia.token);
+	s += "<tptz:PanTilt>true</tptz:PanTilt><tptz:Zoom>true</tptz:Zoom></tptz:Stop>";
+	finishRequest(m_PTZAddress, RequestMotion);
 }
 
 void PTZOnvif::goToHomePosition()
 {
-	QString msg;
-	QXmlStreamWriter s(&msg);
-	writeStartOnvifDocument(s);
-	s.writeStartElement(nsSoapEnvelope, "Envelope");
-	writeHeader(s, nsOnvifPtz + "/" + "GotoHomePosition");
-	s.writeStartElement(nsSoapEnvelope, "Body");
-	s.writeStartElement(nsOnvifPtz, "GotoHomePosition");
-	s.writeTextElement(nsOnvifPtz, "ProfileToken", m_selectedMedia.token);
-	s.writeEndElement(); // GotoHomePosition
-	s.writeEndElement(); // Body
-	s.writeEndElement(); // Envelope
-	s.writeEndDocument();
-	sendRequest(m_PTZAddress, msg);
+	QByteArray &s = beginRequest("GotoHomePosition");
+	s += "<tptz:GotoHomePosition>";
+	appendTextElement(s, "tptz:ProfileToken", m_selectedMedia.token);
+	s += "</tptz:GotoHomePosition>";
+	finishRequest(m_PTZAddress);
 }
 
 void PTZOnvif::memory_set(int i)
 {
 	QString token = m_presetsModel.presetProperty(i, "token").toString();
 	QString name = m_presetsModel.presetProperty(i, "name").toString();
-	QString msg;
-	QXmlStreamWriter s(&msg);
-	writeStartOnvifDocument(s);
-	s.writeStartElement(nsSoapEnvelope, "Envelope");
-	writeHeader(s, nsOnvifPtz + "/" + "SetPreset");
-	s.writeStartElement(nsSoapEnvelope, "Body");
-	s.writeStartElement(nsOnvifPtz, "SetPreset");
-	s.writeTextElement(nsOnvifPtz, "ProfileToken", m_selectedMedia.token);
+	QByteArray &s = beginRequest("SetPreset");
+	s += "<tptz:SetPreset>";
+	appendTextElement(s, "tptz:ProfileToken", m_selectedMedia.token);
 	if (name != "")
-		s.writeTextElement(nsOnvifPtz, "PresetName", name);
+		appendTextElement(s, "tptz:PresetName", name);
 	if (token != "")
-		s.writeTextElement(nsOnvifPtz, "PresetToken", token);
-	s.writeEndElement(); // movetype
-	s.writeEndElement(); // Body
-	s.writeEndElement(); // Envelope
-	s.writeEndDocument();
-	sendRequest(m_PTZAddress, msg);
+		appendTextElement(s, "tptz:PresetToken", token);
+	s += "</tptz:SetPreset>";
+	finishRequest(m_PTZAddress);
 }
 
 void PTZOnvif::memory_reset(int i)
@@ -211,20 +337,12 @@ void PTZOnvif::memory_reset(int i)
 	QString token = m_presetsModel.presetProperty(i, "token").toString();
 	if (token == "")
 		return;
-	QString msg;
-	QXmlStreamWriter s(&msg);
-	writeStartOnvifDocument(s);
-	s.writeStartElement(nsSoapEnvelope, "Envelope");
-	writeHeader(s, nsOnvifPtz + "/" + "RemovePreset");
-	s.writeStartElement(nsSoapEnvelope, "Body");
-	s.writeStartElement(nsOnvifPtz, "RemovePreset");
-	s.writeTextElement(nsOnvifPtz, "ProfileToken", m_selectedMedia.token);
-	s.writeTextElement(nsOnvifPtz, "PresetToken", token);
-	s.writeEndElement(); // movetype
-	s.writeEndElement(); // Body
-	s.writeEndElement(); // Envelope
-	s.writeEndDocument();
-	sendRequest(m_PTZAddress, msg);
+	QByteArray &s = beginRequest("RemovePreset");
+	s += "<tptz:RemovePreset>";
+	appendTextElement(s, "tptz:ProfileToken", m_selectedMedia.token);
+	appendTextElement(s, "tptz:PresetToken", token);
+	s += "</tptz:RemovePreset>";
+	finishRequest(m_PTZAddress);
 }
 
 void PTZOnvif::memory_recall(int i)
@@ -232,173 +350,493 @@ void PTZOnvif::memory_recall(int i)
 	QString token = m_presetsModel.presetProperty(i, "token").toString();
 	if (token == "")
 		return;
-	QString msg;
-	QXmlStreamWriter s(&msg);
-	writeStartOnvifDocument(s);
-	s.writeStartElement(nsSoapEnvelope, "Envelope");
-	writeHeader(s, nsOnvifPtz + "/" + "GotoPreset");
-	s.writeStartElement(nsSoapEnvelope, "Body");
-	s.writeStartElement(nsOnvifPtz, "GotoPreset");
-	s.writeTextElement(nsOnvifPtz, "ProfileToken", m_selectedMedia.token);
-	s.writeTextElement(nsOnvifPtz, "PresetToken", token);
-	s.writeEndElement(); // movetype
-	s.writeEndElement(); // Body
-	s.writeEndElement(); // Envelope
-	s.writeEndDocument();
-	sendRequest(m_PTZAddress, msg);
+	QByteArray &s = beginRequest("GotoPreset");
+	s += "<tptz:GotoPreset>";
+	appendTextElement(s, "tptz:ProfileToken", m_selectedMedia.token);
+	appendTextElement(s, "tptz:PresetToken", token);
+	s += "</tptz:GotoPreset>";
+	finishRequest(m_PTZAddress);
 }
 
 void PTZOnvif::getPresets()
 {
-	QString msg;
-	QXmlStreamWriter s(&msg);
-	writeStartOnvifDocument(s);
-	s.writeStartElement(nsSoapEnvelope, "Envelope");
-	writeHeader(s, nsOnvifPtz + "/" + "GetPresets");
-	s.writeStartElement(nsSoapEnvelope, "Body");
-	s.writeStartElement(nsOnvifPtz, "GetPresets");
-	s.writeTextElement(nsOnvifPtz, "ProfileToken", m_selectedMedia.token);
-	s.writeEndElement(); // movetype
-	s.writeEndElement(); // Body
-	s.writeEndElement(); // Envelope
-	s.writeEndDocument();
-	sendRequest(m_PTZAddress, msg);
-}
-
-void PTZOnvif::handleResponse(QString response)
-{
-	QDomDocument doc;
-	QDomNodeList nl;
-
-#if QT_VERSION >= QT_VERSION_CHECK(6, 8, 0)
-	QDomDocument::ParseOptions options = QDomDocument::ParseOption::UseNamespaceProcessing;
-	doc.setContent(QAnyStringView(response), options);
-#else
-	doc.setContent(response, true);
-#endif
-
-	nl = doc.elementsByTagNameNS(nsOnvifDevice, "GetCapabilitiesResponse");
-	for (int i = 0; i < nl.length(); i++)
-		handleGetCapabilitiesResponse(nl.at(i));
-	nl = doc.elementsByTagNameNS(nsOnvifMedia, "GetProfilesResponse");
-	for (int i = 0; i < nl.length(); i++)
-		handleGetProfilesResponse(nl.at(i));
-	handleGetPresetsResponse(doc);
-}
-
-void PTZOnvif::handleGetCapabilitiesResponse(QDomNode node)
-{
-	auto responseElement = node.toElement();
-	auto pl = responseElement.elementsByTagNameNS(nsOnvifSchema, "PTZ");
-	for (int i = 0; i < pl.length(); i++) {
-		auto e = pl.at(i).toElement();
-		m_PTZAddress = e.firstChildElement("XAddr", nsOnvifSchema).text();
+	QByteArray &s = beginRequest("GetPresets");
+	s += "<tptz:GetPresets>";
+	appendTextElement(s, "tptz:ProfileToken", m_selectedMedia.token);
+	s += "</tptz:GetPresets>";
+	finishRequest(m_PTZAddress);
+}
+
+void PTZOnvif::handleResponse(const OnvifResponse &response)
+{
+	switch (response.kind) {
+	case OnvifResponse::SystemDateAndTime:
+		handleGetSystemDateAndTimeResponse(response);
+		break;
+	case OnvifResponse::Capabilities:
+		handleGetCapabilitiesResponse(response);
+		break;
+	case OnvifResponse::Profiles:
+		handleGetProfilesResponse(response);
+		break;
+	case OnvifResponse::Presets:
+		handleGetPresetsResponse(response);
+		break;
+	case OnvifResponse::Status:
+		handleGetStatusResponse(response);
+		break;
+	case OnvifResponse::Fault:
+		ptz_info("SOAP fault: %s (%s)", QT_TO_UTF8(response.fault), QT_TO_UTF8(response.faultCode));
+		/* The cached profile or service address is no longer valid */
+		if (response.faultCode == "NoProfile" || response.faultCode == "NoPTZProfile" ||
+		    response.faultCode == "ActionNotSupported")
+			restartHandshake();
+		break;
+	case OnvifResponse::Empty:
+		/* Unrecognized reply to the clock sync; don't stall bring-up */
+		if (m_clockSyncPending)
+			handleGetSystemDateAndTimeResponse(response);
+		break;
 	}
+}
 
-	pl = responseElement.elementsByTagNameNS(nsOnvifSchema, "Media");
-	for (int i = 0; i < pl.length(); i++) {
-		auto e = pl.at(i).toElement();
-		m_mediaXAddr = e.firstChildElement("XAddr", nsOnvifSchema).text();
-	}
+void PTZOnvif::handleGetCapabilitiesResponse(const OnvifResponse &response)
+{
+	if (!response.ptzXAddr.isNull())
+		m_PTZAddress = response.ptzXAddr;
+	if (!response.mediaXAddr.isNull())
+		m_mediaXAddr = response.mediaXAddr;
+	if (!response.eventsXAddr.isNull())
+		m_eventsXAddr = response.eventsXAddr;
 	getProfiles();
 }
 
-void PTZOnvif::handleGetProfilesResponse(QDomNode n)
+/*
+ * Service handshake cache. The service addresses and the selected profile are
+ * saved in the device config (preset tokens are already saved with the
+ * presets), so moves can be sent as soon as the device is created. The
+ * handshake still runs once at bring-up to revalidate them in the background,
+ * but settings edits that leave the camera endpoint unchanged don't repeat
+ * it. After that it is only repeated when a request fails in a way that
+ * means the cache is stale, and no more than once per handshake_retry_ms.
+ */
+void PTZOnvif::restartHandshake()
 {
-	QList<MediaProfile> result;
-	auto pl = n.toElement().elementsByTagNameNS(nsOnvifMedia, "Profiles");
-	for (int i = 0; i < pl.length(); i++) {
-		MediaProfile pro;
-		auto e = pl.at(i).toElement();
-		pro.token = e.attribute("token");
-		pro.name = e.firstChildElement("Name", nsOnvifSchema).text();
-		result.push_back(pro);
-	}
-	if (!result.isEmpty())
-		m_selectedMedia = result[0];
+	if (os_gettime_ns() - m_handshakeStartNs < handshake_retry_ms * 1000000ULL)
+		return;
+	ptz_info("ONVIF service error, repeating the service handshake");
+	getCapabilities();
+	m_handshakeStartNs = os_gettime_ns();
+	incrementStatistic("onvif_handshake_count");
+}
+
+void PTZOnvif::handleGetProfilesResponse(const OnvifResponse &response)
+{
+	/* Keep the cached profile if the camera still has it */
+	auto selected = std::find_if(response.profiles.cbegin(), response.profiles.cend(),
+				     [this](const MediaProfile &p) { return p.token == m_selectedMedia.token; });
+	if (selected != response.profiles.cend())
+		m_selectedMedia = *selected;
+	else if (!response.profiles.isEmpty())
+		m_selectedMedia = response.profiles[0];
 	getPresets();
+	scheduleStatusPoll();
+	subscribeEvents();
 }
 
-void PTZOnvif::handleGetPresetsResponse(QDomDocument &doc)
+void PTZOnvif::getStatus()
 {
-	QDomNodeList nodes = doc.elementsByTagNameNS(nsOnvifPtz, "Preset");
-	for (int i = 0; i < nodes.length(); i++) {
-		auto node = nodes.at(i).toElement();
-		QString token = node.attribute("token");
-		auto child = node.firstChildElement("Name", nsOnvifSchema);
-		QString name = child.text();
-		if (token == "")
-			continue;
+	QByteArray &s = beginRequest("GetStatus");
+	s += "<tptz:GetStatus>";
+	appendTextElement(s, "tptz:ProfileToken", m_selectedMedia.token);
+	s += "</tptz:GetStatus>";
+	finishRequest(m_PTZAddress, RequestStatus);
+}
+
+/*
+ * Position polling. GetStatus is polled every status_fast_ms while the camera
+ * is being driven or reports that it is moving, and every status_idle_ms
+ * otherwise. Only one poll is outstanding at a time, and polls are never
+ * closer together than the per-camera budget of status_budget_hz.
+ */
+void PTZOnvif::scheduleStatusPoll()
+{
+	if (m_statusInFlight || m_PTZAddress.isEmpty() || m_selectedMedia.token.isEmpty())
+		return;
+	bool moving = m_cameraMoving || pan_speed || tilt_speed || zoom_speed;
+	/* Move status is pushed while subscribed, so idle polling isn't needed */
+	if (m_eventsActive && !moving)
+		return;
+	int interval = std::max(moving ? status_fast_ms : status_idle_ms, 1000 / status_budget_hz);
+
+	/* Never postpone a poll that is already due sooner */
+	uint64_t since_last = (os_gettime_ns() - m_statusLastNs) / 1000000;
+	int delay = since_last >= (uint64_t)interval ? 0 : interval - (int)since_last;
+	if (m_statusTimer.isActive() && m_statusTimer.remainingTime() <= delay)
+		return;
+	m_statusTimer.start(delay);
+}
+
+void PTZOnvif::pollStatus()
+{
+	if (m_statusInFlight)
+		return;
+	m_statusInFlight = true;
+	m_statusLastNs = os_gettime_ns();
+	incrementStatistic("onvif_status_poll_count");
+	getStatus();
+}
+
+/* Called once per poll, after the reply has been parsed, so the next poll is
+ * scheduled from the move status the camera just reported */
+void PTZOnvif::statusPollFinished()
+{
+	m_statusInFlight = false;
+	scheduleStatusPoll();
+}
 
+void PTZOnvif::handleGetStatusResponse(const OnvifResponse &response)
+{
+	m_cameraMoving = response.moving;
+	statusPollFinished();
+	if (!response.hasPosition)
+		return;
+
+	OBSDataAutoRelease rslt = obs_data_create();
+	obs_data_set_double(rslt, "pan_pos", response.pan);
+	obs_data_set_double(rslt, "tilt_pos", response.tilt);
+	obs_data_set_double(rslt, "zoom_pos", response.zoom);
+	obs_data_apply(settings, rslt);
+	stale_settings.remove("pan_pos");
+	stale_settings.remove("tilt_pos");
+	stale_settings.remove("zoom_pos");
+	markVerified(rslt);
+	obs_data_set_obj(rslt, "statistics", statistics);
+	emit settingsChanged(rslt.Get());
+}
+
+void PTZOnvif::handleGetPresetsResponse(const OnvifResponse &response)
+{
+	for (auto &preset : response.presets) {
 		QVariantMap map;
-		auto psid = m_presetsModel.find("token", token);
+		auto psid = m_presetsModel.find("token", preset.token);
 		if (psid < 0) {
 			psid = m_presetsModel.newPreset();
-			map["token"] = token;
+			map["token"] = preset.token;
 		}
 		if (psid < 0)
 			continue;
-		if (name != "")
-			map["name"] = name;
+		if (preset.name != "")
+			map["name"] = preset.name;
 		m_presetsModel.updatePreset(psid, map);
 	}
 }
 
+/*
+ * PullPoint events. Once the handshake has found an events service a PullPoint
+ * subscription is created and PullMessages is long-polled on a second
+ * QNetworkAccessManager, so an outstanding poll never holds up motion
+ * requests. PTZ move status notifications replace idle status polling. If the
+ * camera refuses the subscription it keeps being polled; a subscription that
+ * is lost is recreated after event_retry_ms.
+ */
+QByteArray &PTZOnvif::beginEventRequest(const QByteArray &actionPrefix, const char *action, const QString &to)
+{
+	QByteArray &s = m_request;
+	s.resize(0);
+	s += envelopeStart();
+	s += actionPrefix;
+	s += action;
+	s += "</wsa5:Action>";
+	appendTextElement(s, "wsa5:To", to);
+	s += securityHeader();
+	s += headerEnd;
+	return s;
+}
+
+void PTZOnvif::postEventRequest(EventRequest type, const QString &url, const QByteArray &body, bool retried)
+{
+	QNetworkRequest request(url);
+	request.setHeader(QNetworkRequest::ContentTypeHeader, "application/soap+xml");
+	request.setRawHeader("Authorization", authorization(request.url()));
+	request.setTransferTimeout((pull_timeout_s + 5) * 1000);
+
+	QNetworkReply *reply = m_eventManager.post(request, body);
+	reply->setProperty("onvif_event", (int)type);
+	reply->setProperty("onvif_body", body);
+	reply->setProperty("onvif_retried", retried);
+	reply->setProperty("onvif_generation", m_eventGeneration);
+}
+
+void PTZOnvif::subscribeEvents()
+{
+	if (m_eventsXAddr.isEmpty() || !m_pullPointAddress.isEmpty() || m_subscribing)
+		return;
+	m_subscribing = true;
+	QByteArray &s = beginEventRequest(eventActionPrefix, "EventPortType/CreatePullPointSubscriptionRequest", m_eventsXAddr);
+	s += "<tev:CreatePullPointSubscription><tev:InitialTerminationTime>PT";
+	s += QByteArray::number(subscription_s);
+	s += "S</tev:InitialTerminationTime></tev:CreatePullPointSubscription>";
+	s += envelopeEnd;
+	postEventRequest(EventSubscribe, m_eventsXAddr, s);
+}
+
+void PTZOnvif::pullMessages()
+{
+	QByteArray &s = beginEventRequest(eventActionPrefix, "PullPointSubscription/PullMessagesRequest", m_pullPointAddress);
+	s += "<tev:PullMessages><tev:Timeout>PT";
+	s += QByteArray::number(pull_timeout_s);
+	s += "S</tev:Timeout><tev:MessageLimit>32</tev:MessageLimit></tev:PullMessages>";
+	s += envelopeEnd;
+	postEventRequest(EventPull, m_pullPointAddress, s);
+}
+
+void PTZOnvif::renewSubscription()
+{
+	m_renewNs = os_gettime_ns();
+	QByteArray &s = beginEventRequest(wsnActionPrefix, "SubscriptionManager/RenewRequest", m_pullPointAddress);
+	s += "<wsnt:Renew><wsnt:TerminationTime>PT";
+	s += QByteArray::number(subscription_s);
+	s += "S</wsnt:TerminationTime></wsnt:Renew>";
+	s += envelopeEnd;
+	postEventRequest(EventRenew, m_pullPointAddress, s);
+}
+
+/* The camera has dropped the subscription. Replies to requests already sent
+ * on it are ignored; poll for status until it has been recreated */
+void PTZOnvif::subscriptionLost()
+{
+	m_eventGeneration++;
+	m_pullPointAddress.clear();
+	m_eventsActive = false;
+	obs_data_set_bool(statistics, "onvif_events_active", false);
+	scheduleStatusPoll();
+	m_eventTimer.start(event_retry_ms);
+}
+
+/* Drop the subscription; replies to requests already sent are ignored */
+void PTZOnvif::resetEvents()
+{
+	m_eventGeneration++;
+	m_eventsXAddr.clear();
+	m_pullPointAddress.clear();
+	m_eventsActive = false;
+	m_subscribing = false;
+	m_eventTimer.stop();
+	obs_data_set_bool(statistics, "onvif_events_active", false);
+}
+
+void PTZOnvif::eventRequestFinished(QNetworkReply *reply)
+{
+	reply->deleteLater();
+	int generation = reply->property("onvif_generation").toInt();
+	if (generation != m_eventGeneration)
+		return;
+	auto type = (EventRequest)reply->property("onvif_event").toInt();
+	int status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+
+	if (status == 401 && !reply->property("onvif_retried").toBool() && cacheDigestChallenge(reply)) {
+		incrementStatistic("onvif_auth_retry_count");
+		postEventRequest(type, reply->url().toString(), reply->property("onvif_body").toByteArray(), true);
+		return;
+	}
+
+	QByteArray response = reply->readAll();
+	strand->post([this, type, response, status, generation]() {
+		OnvifResponse parsed = OnvifResponse::parse(response);
+		QMetaObject::invokeMethod(
+			this,
+			[this, type, parsed, status, generation]() {
+				if (generation == m_eventGeneration)
+					handleEventResponse(type, parsed, status);
+			},
+			Qt::QueuedConnection);
+	});
+}
+
+void PTZOnvif::handleEventResponse(EventRequest type, const OnvifResponse &response, int status)
+{
+	switch (type) {
+	case EventSubscribe:
+		m_subscribing = false;
+		if (response.kind == OnvifResponse::PullPointSubscription && !response.subscriptionAddress.isEmpty()) {
+			m_pullPointAddress = response.subscriptionAddress;
+			m_eventsActive = true;
+			m_renewNs = os_gettime_ns();
+			obs_data_set_bool(statistics, "onvif_events_active", true);
+			ptz_debug("ONVIF PullPoint subscription %s", QT_TO_UTF8(m_pullPointAddress));
+			pullMessages();
+		} else if (status == 0) {
+			/* No answer at all; try again later */
+			m_eventTimer.start(event_retry_ms);
+		} else {
+			ptz_info("ONVIF events unavailable, polling for status");
+		}
+		break;
+	case EventPull:
+		if (response.kind != OnvifResponse::PullMessages) {
+			subscriptionLost();
+			break;
+		}
+		for (auto &notification : response.notifications)
+			handleNotification(notification);
+		if (os_gettime_ns() - m_renewNs >= subscription_s * 500000000ULL)
+			renewSubscription();
+		pullMessages();
+		break;
+	case EventRenew:
+		/* Without a renewal the subscription will expire under the
+		 * outstanding pull; start over now */
+		if (status != 200 || response.kind == OnvifResponse::Fault) {
+			ptz_info("ONVIF subscription renewal failed (HTTP %i) %s", status, QT_TO_UTF8(response.fault));
+			incrementStatistic("onvif_event_renew_error_count");
+			subscriptionLost();
+		}
+		break;
+	}
+}
+
+/*
+ * Cameras name the move status items differently (MoveStatus, PanTiltStatus,
+ * etc.) but agree on the MOVING and IDLE values, so PTZ notifications are
+ * matched on value.
+ */
+void PTZOnvif::handleNotification(const OnvifNotification &notification)
+{
+	incrementStatistic("onvif_event_count");
+	if (!notification.topic.contains("PTZ"))
+		return;
+	int moving = -1;
+	for (auto &item : notification.data) {
+		if (item.second == "MOVING")
+			moving = 1;
+		else if (item.second == "IDLE" && moving < 0)
+			moving = 0;
+	}
+	if (moving < 0)
+		return;
+
+	m_cameraMoving = moving;
+	if (m_cameraMoving)
+		scheduleStatusPoll();
+	else if (!m_statusInFlight)
+		m_statusTimer.start(0); /* Move finished; fetch the final position */
+
+	OBSDataAutoRelease rslt = obs_data_create();
+	obs_data_set_bool(rslt, "moving", m_cameraMoving);
+	obs_data_apply(settings, rslt);
+	obs_data_set_obj(rslt, "statistics", statistics);
+	emit settingsChanged(rslt.Get());
+}
+
 void PTZOnvif::getCapabilities()
 {
-	const QString hostformat("http://%1:%2/onvif/device_service");
-	QString msg;
-	QXmlStreamWriter s(&msg);
-	writeStartOnvifDocument(s);
-	s.writeStartElement(nsSoapEnvelope, "Envelope");
-	writeHeader(s);
-	s.writeStartElement(nsSoapEnvelope, "Body");
-	s.writeStartElement(nsOnvifDevice, "GetCapabilities");
-	s.writeTextElement(nsOnvifDevice, "Category", "All");
-	s.writeEndElement(); // movetype
-	s.writeEndElement(); // Body
-	s.writeEndElement(); // Envelope
-	s.writeEndDocument();
-	sendRequest(hostformat.arg(host).arg(port), msg);
+	QByteArray &s = beginRequest();
+	s += "<tds:GetCapabilities><tds:Category>All</tds:Category></tds:GetCapabilities>";
+	finishRequest(QString("http://%1:%2%3").arg(host).arg(port).arg(device_path));
 }
 
 void PTZOnvif::getProfiles()
 {
-	QString msg;
-	QXmlStreamWriter s(&msg);
-	writeStartOnvifDocument(s);
-	s.writeStartElement(nsSoapEnvelope, "Envelope");
-	writeHeader(s);
-	s.writeStartElement(nsSoapEnvelope, "Body");
-	s.writeEmptyElement(nsOnvifMedia, "GetProfiles");
-	s.writeEndElement(); // Body
-	s.writeEndElement(); // Envelope
-	s.writeEndDocument();
-	sendRequest(m_mediaXAddr, msg);
+	QByteArray &s = beginRequest();
+	s += "<trt:GetProfiles/>";
+	finishRequest(m_mediaXAddr);
 }
 
 void PTZOnvif::requestFinished(QNetworkReply *reply)
 {
 	auto statusCodeV = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+	reply->deleteLater();
+
+	m_inFlight--;
+	uint64_t latency = os_gettime_ns() - reply->property("onvif_start_ns").toULongLong();
+	m_latencyCount++;
+	m_latencyTotalNs += latency;
+	m_latencyMaxNs = std::max(m_latencyMaxNs, latency);
+	obs_data_set_double(statistics, "onvif_latency_ms", latency / 1000000.0);
+	obs_data_set_double(statistics, "onvif_latency_avg_ms", m_latencyTotalNs / 1000000.0 / m_latencyCount);
+	obs_data_set_double(statistics, "onvif_latency_max_ms", m_latencyMaxNs / 1000000.0);
+	incrementStatistic("onvif_request_count");
+
+	/* New or stale Digest challenge; answer it once and resend in place */
+	if (statusCodeV == 401 && !reply->property("onvif_retried").toBool() && cacheDigestChallenge(reply)) {
+		incrementStatistic("onvif_auth_retry_count");
+		m_pending.prepend({reply->url().toString(), reply->property("onvif_body").toByteArray(), true,
+				   (RequestClass)reply->property("onvif_class").toInt()});
+		pumpRequests();
+		return;
+	}
 
-	m_isBusy = false;
+	auto cls = (RequestClass)reply->property("onvif_class").toInt();
+	/* Successful polls finish once the reply has been parsed */
+	bool status_poll = cls == RequestStatus && reply->error() == QNetworkReply::NoError;
+	if (cls == RequestStatus && !status_poll)
+		statusPollFinished();
+	if (cls == RequestMotion) {
+		m_moveInFlight = false;
+		m_moveRttTotalNs += latency;
+		m_moveRttCount++;
+		obs_data_set_int(statistics, "onvif_move_count", m_moveRttCount);
+		obs_data_set_double(statistics, "onvif_move_rtt_ms", latency / 1000000.0);
+		obs_data_set_double(statistics, "onvif_move_rtt_avg_ms", m_moveRttTotalNs / 1000000.0 / m_moveRttCount);
+	}
 	if (reply->error() > 0) {
 		ptz_info("request error; message: %s, code: %i", QT_TO_UTF8(reply->errorString()), statusCodeV);
-	} else {
-		handleResponse(reply->readAll());
+		/* Carry on with the local clock if the camera can't report its time */
+		if (m_clockSyncPending) {
+			m_clockSyncPending = false;
+			getCapabilities();
+		}
+		if (statusCodeV == 404)
+			restartHandshake();
 	}
-	do_update();
+	/* Error replies are parsed too, as they usually carry a SOAP fault */
+	if (reply->error() == QNetworkReply::NoError || statusCodeV >= 400) {
+		/* Parse off the main thread; the device strand keeps responses
+		 * in order and the results are handled back on this thread */
+		QByteArray response = reply->readAll();
+		bool clock_sync = m_clockSyncPending;
+		strand->post([this, response, clock_sync, status_poll]() {
+			OnvifResponse parsed = OnvifResponse::parse(response);
+			if (parsed.kind == OnvifResponse::Empty && !clock_sync && !status_poll)
+				return;
+			QMetaObject::invokeMethod(
+				this,
+				[this, parsed, status_poll]() {
+					handleResponse(parsed);
+					/* Don't let a reply that isn't a status stall polling */
+					if (status_poll && parsed.kind != OnvifResponse::Status)
+						statusPollFinished();
+				},
+				Qt::QueuedConnection);
+		});
+	}
+	pumpRequests();
+	sendMotion();
 }
 
 PTZOnvif::PTZOnvif(OBSData config) : PTZDevice(config)
 {
-	// for digest authenticaton request
-	connect(&m_networkManager, SIGNAL(authenticationRequired(QNetworkReply *, QAuthenticator *)), this,
-		SLOT(authRequired(QNetworkReply *, QAuthenticator *)));
+	strand = PTZStrand::create();
+	m_statusTimer.setSingleShot(true);
+	m_statusTimer.setCallback([this]() { pollStatus(); });
+	m_eventTimer.setSingleShot(true);
+	m_eventTimer.setCallback([this]() { subscribeEvents(); });
+	snapshot_keys = {"pan_pos", "tilt_pos", "zoom_pos"};
+	/* Digest authentication is answered in requestFinished() so that the
+	 * challenge can be cached. authenticationRequired is deliberately left
+	 * unconnected so the 401 reply comes back to us */
 	connect(&m_networkManager, SIGNAL(finished(QNetworkReply *)), this, SLOT(requestFinished(QNetworkReply *)));
+	connect(&m_eventManager, SIGNAL(finished(QNetworkReply *)), this,
+		SLOT(eventRequestFinished(QNetworkReply *)));
 	set_config(config);
 }
 
+PTZOnvif::~PTZOnvif()
+{
+	strand->close();
+}
+
 QString PTZOnvif::description()
 {
 	return QString("ONVIF %1@%2:%3").arg(username, host, QString::number(port));
@@ -406,20 +844,79 @@ QString PTZOnvif::description()
 
 void PTZOnvif::connectCamera()
 {
+	m_handshakeStartNs = os_gettime_ns();
+	incrementStatistic("onvif_handshake_count");
+	/* Warm up the connection while the first request is being built */
+	m_networkManager.connectToHost(host, port);
+	if (m_clockSynced)
+		getCapabilities();
+	else
+		getSystemDateAndTime();
+}
+
+/* GetSystemDateAndTime must be answered without authentication, so it is
+ * safe to send before the clock offset is known */
+void PTZOnvif::getSystemDateAndTime()
+{
+	m_clockSyncPending = true;
+	QByteArray &s = beginRequest();
+	s += "<tds:GetSystemDateAndTime/>";
+	finishRequest(QString("http://%1:%2%3").arg(host).arg(port).arg(device_path));
+}
+
+void PTZOnvif::handleGetSystemDateAndTimeResponse(const OnvifResponse &response)
+{
+	if (response.utcTime.isValid()) {
+		m_clockOffsetMs = QDateTime::currentDateTimeUtc().msecsTo(response.utcTime);
+		m_securityHeader.clear();
+		obs_data_set_int(statistics, "onvif_clock_offset_ms", m_clockOffsetMs);
+		ptz_debug("ONVIF camera clock offset %lli ms", (long long)m_clockOffsetMs);
+	}
+	m_clockSynced = true;
+	m_clockSyncPending = false;
+	/* A cached profile can be polled while the handshake revalidates it */
+	scheduleStatusPoll();
 	getCapabilities();
 }
 
 void PTZOnvif::do_update()
 {
 	if (status & (STATUS_PANTILT_SPEED_CHANGED | STATUS_ZOOM_SPEED_CHANGED)) {
-		if (pan_speed == 0.0 && tilt_speed == 0.0 && zoom_speed == 0.0) {
-			status &= ~(STATUS_PANTILT_SPEED_CHANGED | STATUS_ZOOM_SPEED_CHANGED);
-			stop();
-		} else if (!m_isBusy) {
-			m_isBusy = true;
-			status &= ~(STATUS_PANTILT_SPEED_CHANGED | STATUS_ZOOM_SPEED_CHANGED);
-			continuousMove(pan_speed, tilt_speed, zoom_speed);
-		}
+		status &= ~(STATUS_PANTILT_SPEED_CHANGED | STATUS_ZOOM_SPEED_CHANGED);
+		if (m_movePending)
+			incrementStatistic("onvif_move_superseded_count");
+		m_movePending = true;
+		scheduleStatusPoll();
+	}
+	sendMotion();
+}
+
+/*
+ * Velocity streaming. Only one ContinuousMove or Stop is in flight at a time
+ * and at most one more is pending. The pending update isn't built until it is
+ * sent, so it always carries the newest velocity; intermediate values are
+ * dropped. A Stop goes through the same slot, so it can never overtake a move.
+ */
+void PTZOnvif::sendMotion()
+{
+	if (m_moveInFlight || !m_movePending)
+		return;
+	m_movePending = false;
+	m_moveInFlight = true;
+	if (pan_speed == 0.0 && tilt_speed == 0.0 && zoom_speed == 0.0)
+		stop();
+	else
+		continuousMove(pan_speed, tilt_speed, zoom_speed);
+
+	/* Effective update rate, averaged over roughly one second */
+	uint64_t now = os_gettime_ns();
+	m_moveRateCount++;
+	if (now - m_moveRateStartNs >= 1000000000) {
+		if (m_moveRateStartNs)
+			obs_data_set_double(statistics, "onvif_move_rate_hz",
+					    m_moveRateCount * 1000000000.0 / (now - m_moveRateStartNs));
+		m_moveRateStartNs = now;
+		m_moveRateCount = 0;
 	}
 }
 
@@ -443,6 +940,18 @@ void PTZOnvif::zoom_abs(double pos)
 	absoluteMove(0.0, 0.0, pos);
 }
 
+const char *PTZOnvif::default_device_path = "/onvif/device_service";
+
+/* The path is only included when it isn't the default, so existing caches
+ * stay valid */
+QString PTZOnvif::handshakeEndpoint(const QString &username, const QString &host, int port, const QString &path)
+{
+	QString endpoint = QString("%1@%2:%3").arg(username, host, QString::number(port));
+	if (path != default_device_path)
+		endpoint += path;
+	return endpoint;
+}
+
 void PTZOnvif::set_config(OBSData config)
 {
 	PTZDevice::set_config(config);
@@ -450,11 +959,29 @@ void PTZOnvif::set_config(OBSData config)
 	port = (int)obs_data_get_int(config, "port");
 	username = obs_data_get_string(config, "username");
 	password = obs_data_get_string(config, "password");
+	m_securityHeader.clear();
 	if (username == "")
 		username = "admin";
 	if (!port)
 		port = 8899;
-	connectCamera();
+	device_path = obs_data_get_string(config, "device_service_path");
+	if (device_path.isEmpty())
+		device_path = default_device_path;
+
+	QString endpoint = handshakeEndpoint(username, host, port, device_path);
+	if (endpoint == m_handshakeEndpoint && !m_selectedMedia.token.isEmpty())
+		return;
+	if (endpoint != m_handshakeEndpoint) {
+		bool cached = endpoint == obs_data_get_string(config, "onvif_endpoint");
+		m_handshakeEndpoint = endpoint;
+		m_PTZAddress = cached ? obs_data_get_string(config, "onvif_ptz_xaddr") : "";
+		m_mediaXAddr = cached ? obs_data_get_string(config, "onvif_media_xaddr") : "";
+		m_selectedMedia.token = cached ? obs_data_get_string(config, "onvif_profile_token") : "";
+		m_selectedMedia.name = cached ? obs_data_get_string(config, "onvif_profile_name") : "";
+		m_clockSynced = false;
+		resetEvents();
+	}
+	ptzDeviceList.bring_up(this, "host:" + host, [this]() { connectCamera(); }, true);
 }
 
 OBSData PTZOnvif::get_config()
@@ -464,6 +991,15 @@ OBSData PTZOnvif::get_config()
 	obs_data_set_int(config, "port", port);
 	obs_data_set_string(config, "username", QT_TO_UTF8(username));
 	obs_data_set_string(config, "password", QT_TO_UTF8(password));
+	if (device_path != default_device_path)
+		obs_data_set_string(config, "device_service_path", QT_TO_UTF8(device_path));
+	if (!m_selectedMedia.token.isEmpty()) {
+		obs_data_set_string(config, "onvif_endpoint", QT_TO_UTF8(m_handshakeEndpoint));
+		obs_data_set_string(config, "onvif_ptz_xaddr", QT_TO_UTF8(m_PTZAddress));
+		obs_data_set_string(config, "onvif_media_xaddr", QT_TO_UTF8(m_mediaXAddr));
+		obs_data_set_string(config, "onvif_profile_token", QT_TO_UTF8(m_selectedMedia.token));
+		obs_data_set_string(config, "onvif_profile_name", QT_TO_UTF8(m_selectedMedia.name));
+	}
 	return config;
 }
 
@@ -476,6 +1012,8 @@ obs_properties_t *PTZOnvif::get_obs_properties()
 	obs_properties_add_text(config, "warning", "Warning: ONVIF support is experimental", OBS_TEXT_INFO);
 	obs_properties_add_text(config, "host", "IP Host", OBS_TEXT_DEFAULT);
 	obs_properties_add_int(config, "port", "TCP port", 1, 65535, 1);
+	obs_properties_add_text(config, "device_service_path", "Device service path (blank for default)",
+				OBS_TEXT_DEFAULT);
 	obs_properties_add_text(config, "username", "Username", OBS_TEXT_DEFAULT);
 	obs_properties_add_text(config, "password", "Password", OBS_TEXT_DEFAULT);
 	return ptz_props;
@@ -8,10 +8,9 @@
 
 #include <QObject>
 #include "ptz-device.hpp"
+#include "onvif-parser.hpp"
 #include <QNetworkAccessManager>
 #include <QNetworkReply>
-#include <QtXml/QDomDocument>
-#include <QXmlStreamWriter>
 #include <QObject>
 #include <QUuid>
 #include <QAuthenticator>
@@ -20,19 +19,13 @@
 #include <QTimer>
 #include <QList>
 
-class MediaProfile {
-public:
-	QString name;
-	QString token;
-};
-
 class PTZOnvif : public PTZDevice {
 	Q_OBJECT
 
 private:
-	bool m_isBusy = false;
 	QString host;
 	int port;
+	QString device_path; /* Path of the device service on the camera */
 	QString username;
 	QString password;
 	QNetworkAccessManager m_networkManager;
@@ -41,19 +34,110 @@ private:
 	QString m_PTZAddress{""};
 	MediaProfile m_selectedMedia;
 
+	/* Service handshake cache */
+	static const int handshake_retry_ms = 5000;
+	QString m_handshakeEndpoint;
+	uint64_t m_handshakeStartNs = 0;
+	void restartHandshake();
+
+	/* HTTP session */
+	/* Motion and status requests are tracked separately from the rest */
+	enum RequestClass { RequestGeneric, RequestMotion, RequestStatus };
+	struct PendingRequest {
+		QString url;
+		QByteArray body;
+		bool retried;
+		RequestClass cls;
+	};
+	static const int max_in_flight = 2;
+	QList<PendingRequest> m_pending;
+	int m_inFlight = 0;
+	QByteArray m_digestRealm;
+	QByteArray m_digestNonce;
+	QByteArray m_digestOpaque;
+	bool m_digestQopAuth = false;
+	int m_digestCount = 0;
+	uint64_t m_latencyCount = 0;
+	uint64_t m_latencyTotalNs = 0;
+	uint64_t m_latencyMaxNs = 0;
+
+	/* Velocity streaming */
+	bool m_moveInFlight = false;
+	bool m_movePending = false;
+	uint64_t m_moveRttCount = 0;
+	uint64_t m_moveRttTotalNs = 0;
+	uint64_t m_moveRateStartNs = 0;
+	uint64_t m_moveRateCount = 0;
+	void sendMotion();
+
+	/* Position polling */
+	static const int status_fast_ms = 100;
+	static const int status_idle_ms = 2000;
+	static const int status_budget_hz = 10;
+	PTZTimer m_statusTimer;
+	bool m_statusInFlight = false;
+	bool m_cameraMoving = false;
+	uint64_t m_statusLastNs = 0;
+	void getStatus();
+	void scheduleStatusPoll();
+	void statusPollFinished();
+	void pollStatus();
+
+	/* PullPoint event subscription, on its own connection */
+	enum EventRequest { EventSubscribe, EventPull, EventRenew };
+	static const int pull_timeout_s = 10;
+	static const int subscription_s = 60;
+	static const int event_retry_ms = 5000;
+	QNetworkAccessManager m_eventManager;
+	QString m_eventsXAddr;
+	QString m_pullPointAddress;
+	PTZTimer m_eventTimer;
+	bool m_eventsActive = false;
+	bool m_subscribing = false;
+	int m_eventGeneration = 0;
+	uint64_t m_renewNs = 0;
+	QByteArray &beginEventRequest(const QByteArray &actionPrefix, const char *action, const QString &to);
+	void postEventRequest(EventRequest type, const QString &url, const QByteArray &body, bool retried = false);
+	void subscribeEvents();
+	void pullMessages();
+	void renewSubscription();
+	void subscriptionLost();
+	void resetEvents();
+	void handleEventResponse(EventRequest type, const OnvifResponse &response, int status);
+	void handleNotification(const OnvifNotification &notification);
+	void pumpRequests();
+	void postRequest(const PendingRequest &pending);
+	QByteArray authorization(const QUrl &url);
+	bool cacheDigestChallenge(QNetworkReply *reply);
+
 	// SOAP/XML helpers
-	void writeHeader(QXmlStreamWriter &s, const QString action);
+	QByteArray m_request;
+	QByteArray &beginRequest(const char *ptz_action = nullptr);
+	const QByteArray &securityHeader();
 
-	void sendRequest(QString host, QString req);
+	/* WS-Security UsernameToken cache */
+	static const int token_lifetime_ms = 5000;
+	QByteArray m_securityHeader;
+	uint64_t m_securityHeaderNs = 0;
+	qint64 m_clockOffsetMs = 0;
+	bool m_clockSynced = false;
+	bool m_clockSyncPending = false;
+	void finishRequest(const QString &url, RequestClass cls = RequestGeneric);
+
+	void sendRequest(QString host, const QByteArray &req, RequestClass cls = RequestGeneric);
+	void getSystemDateAndTime();
 	void getCapabilities();
 	void getProfiles();
 	void getPresets();
-	void handleResponse(QString response);
-	void handleGetPresetsResponse(QDomDocument &doc);
-	void handleGetCapabilitiesResponse(QDomNode node);
-	void handleGetProfilesResponse(QDomNode node);
+	void handleResponse(const OnvifResponse &response);
+	void handleGetSystemDateAndTimeResponse(const OnvifResponse &response);
+	void handleGetPresetsResponse(const OnvifResponse &response);
+	void handleGetCapabilitiesResponse(const OnvifResponse &response);
+	void handleGetProfilesResponse(const OnvifResponse &response);
+	void handleGetStatusResponse(const OnvifResponse &response);
 
-	void genericMove(QString movetype, QString property, double pan, double tilt, double zoom);
+	void genericMove(const char *movetype, const char *property, double pan, double tilt, double zoom,
+			 RequestClass cls = RequestGeneric);
 	void continuousMove(double x, double y, double z);
 	void absoluteMove(int x, int y, int z);
 	void relativeMove(int x, int y, int z);
@@ -62,11 +146,18 @@ private:
 
 private slots:
 	void connectCamera();
-	void authRequired(QNetworkReply *reply, QAuthenticator *authenticator);
 	void requestFinished(QNetworkReply *reply);
+	void eventRequestFinished(QNetworkReply *reply);
 
 public:
+	static QByteArray buildRequest(const QString &username, const QString &password, const QByteArray &body);
+	static const char *default_device_path;
+	/* Identifies the camera a cached service handshake belongs to; stored
+	 * in the config as onvif_endpoint */
+	static QString handshakeEndpoint(const QString &username, const QString &host, int port, const QString &path);
+
 	PTZOnvif(OBSData config);
+	~PTZOnvif();
 	virtual QString description();
 
 	void set_config(OBSData ptz_data);
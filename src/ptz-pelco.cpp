@@ -17,6 +17,68 @@ std::map<QString, PelcoUART *> PelcoUART::interfaces;
  * Pelco UART wrapper implementation
  */
 
+PelcoUART::PelcoUART(QString &port_name) : PTZUARTWrapper(port_name)
+{
+	pace_timer.setSingleShot(true);
+	pace_timer.setCallback([this]() { pump(); });
+}
+
+/* 8N1 framing: 10 bits on the wire per byte */
+uint64_t PelcoUART::wire_time_ns(int bytes)
+{
+	int baud = baudRate() > 0 ? baudRate() : 2400;
+	return (uint64_t)bytes * 10 * 1000000000ULL / baud;
+}
+
+/* Byte 1 is the camera address in both Pelco-D and Pelco-P frames */
+void PelcoUART::sendFrame(const QByteArray &frame, int coalesce_key)
+{
+	if (coalesce_key >= 0) {
+		for (qsizetype i = tx_queue.size() - 1; i >= 0; i--) {
+			const TxFrame &pending = tx_queue[i];
+			if (pending.key == coalesce_key) {
+				tx_queue[i].frame = frame;
+				coalesced_count++;
+				pump();
+				return;
+			}
+			/* Don't move the update ahead of a command for the same camera */
+			if (pending.key < 0 && pending.frame[1] == frame[1])
+				break;
+		}
+	}
+	tx_queue.append({coalesce_key, frame});
+	pump();
+}
+
+void PelcoUART::pump()
+{
+	uint64_t now = os_gettime_ns();
+	if (line_free_ns > now) {
+		if (!pace_timer.isActive())
+			pace_timer.start((int)((line_free_ns - now + 999999) / 1000000));
+		return;
+	}
+
+	if (tx_queue.isEmpty())
+		return;
+	QByteArray frame = tx_queue.takeFirst().frame;
+
+	send(frame);
+	line_free_ns = now + wire_time_ns(frame.size());
+	if (!tx_queue.isEmpty())
+		pace_timer.start((int)((line_free_ns - now + 999999) / 1000000));
+}
+
+void PelcoUART::writeStatistics(obs_data_t *data)
+{
+	PTZUARTWrapper::writeStatistics(data);
+	obs_data_set_int(data, "pelco_coalesced_count", coalesced_count);
+	obs_data_set_int(data, "pelco_tx_pending", tx_queue.size());
+	obs_data_set_int(data, "pelco_rx_resync_count", resync_count);
+	obs_data_set_int(data, "pelco_rx_checksum_error_count", checksum_error_count);
+}
+
 void PelcoUART::receive_datagram(const QByteArray &packet)
 {
 	blog(LOG_DEBUG, "%s <-- %s", qPrintable(port_name), packet.toHex(':').data());
@@ -24,14 +86,43 @@ void PelcoUART::receive_datagram(const QByteArray &packet)
 	emit receive(packet);
 }
 
+/*
+ * Pelco-D frames are 7 bytes starting with 0xff. Pelco-P frames are 8 bytes
+ * starting with 0xa0 with 0xaf in the 7th byte. Anything that doesn't start
+ * with a sync byte, or fails the checksum, is discarded one byte at a time
+ * until the stream lines up again.
+ */
 void PelcoUART::receiveBytes(const QByteArray &data)
 {
-	for (auto b : data) {
-		rxbuffer += b;
-		if (rxbuffer.size() >= messageLength) {
-			receive_datagram(rxbuffer);
-			rxbuffer.clear();
+	rxbuffer += data;
+	while (!rxbuffer.isEmpty()) {
+		uint8_t sync = rxbuffer[0];
+		int len;
+		if (sync == 0xff) {
+			len = 7;
+		} else if (sync == 0xa0) {
+			len = 8;
+		} else {
+			rxbuffer.remove(0, 1);
+			resync_count++;
+			continue;
 		}
+		if (rxbuffer.size() < len)
+			return;
+
+		QByteArray frame = rxbuffer.left(len);
+		bool valid;
+		if (sync == 0xff)
+			valid = checkSum(frame.mid(1, 5), true) == frame[6];
+		else
+			valid = (uint8_t)frame[6] == 0xaf && checkSum(frame.left(7), false) == frame[7];
+		if (!valid) {
+			rxbuffer.remove(0, 1);
+			checksum_error_count++;
+			continue;
+		}
+		rxbuffer.remove(0, len);
+		receive_datagram(frame);
 	}
 }
 
@@ -44,7 +135,6 @@ PelcoUART *PelcoUART::get_interface(QString port_name)
 	if (!iface) {
 		blog(LOG_DEBUG, "Creating new Pelco UART object %s", qPrintable(port_name));
 		iface = new PelcoUART(port_name);
-		iface->open();
 		interfaces[port_name] = iface;
 	}
 	return iface;
@@ -68,14 +158,13 @@ void PTZPelco::attach_interface(PelcoUART *new_iface)
 		connect(iface, &PelcoUART::receive, this, &PTZPelco::receive);
 }
 
-char PTZPelco::checkSum(QByteArray &data)
+char PelcoUART::checkSum(const QByteArray &data, bool pelco_d)
 {
 	int sum = 0x00;
-	if (use_pelco_d) {
-		/* Pelco-D checksum */
+	if (pelco_d) {
+		/* Pelco-D checksum: sum modulo 256 of the bytes after the sync */
 		for (char c : data)
-			sum += c;
-		sum = sum % 100;
+			sum += (uint8_t)c;
 	} else {
 		/* Pelco-P checksum */
 		for (char c : data)
@@ -87,36 +176,87 @@ char PTZPelco::checkSum(QByteArray &data)
 
 void PTZPelco::receive(const QByteArray &msg)
 {
-	unsigned int addr = msg[1];
+	unsigned int addr = (uint8_t)msg[1];
 	if (!use_pelco_d)
 		addr++;
-	if (addr == this->address)
-		ptz_debug("Pelco received: %s", qPrintable(msg.toHex()));
+	if (addr != this->address)
+		return;
+	ptz_debug("Pelco received: %s", qPrintable(msg.toHex()));
+
+	/* Pelco-D query responses: ff addr 00 cmd msb lsb cksum */
+	if (msg.size() != 7 || (uint8_t)msg[0] != 0xff)
+		return;
+	int value = (uint8_t)msg[4] << 8 | (uint8_t)msg[5];
+	const char *name;
+	switch ((uint8_t)msg[3]) {
+	case 0x59: /* Pan position, hundredths of a degree */
+		name = "pan_pos";
+		break;
+	case 0x5b: /* Tilt position, hundredths of a degree */
+		name = "tilt_pos";
+		break;
+	case 0x5d: /* Zoom position, fraction of full range x 65535 */
+		name = "zoom_pos";
+		break;
+	default:
+		return;
+	}
+
+	status |= STATUS_CONNECTED;
+	position_unanswered = 0;
+	OBSDataAutoRelease rslt = obs_data_create();
+	obs_data_set_int(rslt, name, value);
+	obs_data_apply(settings, rslt);
+	stale_settings -= name;
+	markVerified(rslt);
+	obs_data_set_obj(rslt, "statistics", statistics);
+	emit settingsChanged(rslt.Get());
 }
 
-void PTZPelco::send(const QByteArray &msg)
+/* Position queries are only defined for Pelco-D. Poll while the camera is
+ * moving, and once more after it stops */
+void PTZPelco::query_position()
+{
+	if (!use_pelco_d || !iface || position_unanswered >= position_query_limit) {
+		position_timer.stop();
+		return;
+	}
+	if (!(pan_speed || tilt_speed || zoom_speed))
+		position_timer.stop();
+	if (++position_unanswered == position_query_limit)
+		ptz_info("no position reply after %i queries, giving up", position_query_limit);
+
+	stale_settings.insert("pan_pos");
+	stale_settings.insert("tilt_pos");
+	stale_settings.insert("zoom_pos");
+	send(0x00, 0x51, 0x00, 0x00, address << 8 | 0x51);
+	send(0x00, 0x53, 0x00, 0x00, address << 8 | 0x53);
+	send(0x00, 0x55, 0x00, 0x00, address << 8 | 0x55);
+}
+
+void PTZPelco::send(const QByteArray &msg, int coalesce_key)
 {
 	QByteArray result = msg;
 	if (use_pelco_d) {
 		/* Pelco-D datagram */
 		result.prepend(address);
-		result.append(checkSum(result));
+		result.append(PelcoUART::checkSum(result, true));
 		result.prepend(QByteArray::fromHex("ff"));
 	} else {
 		/* Pelco-P datagram */
 		result.prepend(address - 1);
 		result.prepend(QByteArray::fromHex("a0"));
 		result.append(QByteArray::fromHex("af"));
-		result.append(checkSum(result));
+		result.append(PelcoUART::checkSum(result, false));
 	}
 
-	iface->send(result);
+	iface->sendFrame(result, coalesce_key);
 
 	ptz_debug("Pelco %c command send: %s", use_pelco_d ? 'D' : 'P', qPrintable(result.toHex(':')));
 }
 
 void PTZPelco::send(const unsigned char data_1, const unsigned char data_2, const unsigned char data_3,
-		    const unsigned char data_4)
+		    const unsigned char data_4, int coalesce_key)
 {
 	QByteArray message;
 	message.resize(4);
@@ -125,21 +265,26 @@ void PTZPelco::send(const unsigned char data_1, const unsigned char data_2, cons
 	message[2] = data_3;
 	message[3] = data_4;
 
-	send(message);
+	send(message, coalesce_key);
 }
 
+/* Motion and speed updates are coalesced per address; only the latest of each
+ * is sent once the line is free */
+#define PELCO_KEY_MOTION 0
 void PTZPelco::focus_speed_set(double speed)
 {
-	send(0x00, 0x27, 0x00, abs(speed) * 0x33);
+	send(0x00, 0x27, 0x00, abs(speed) * 0x33, address << 8 | 0x27);
 }
 
 void PTZPelco::zoom_speed_set(double speed)
 {
-	send(0x00, 0x25, 0x00, abs(speed) * 0x33);
+	send(0x00, 0x25, 0x00, abs(speed) * 0x33, address << 8 | 0x25);
 }
 
 PTZPelco::PTZPelco(OBSData data) : PTZDevice(data), iface(NULL)
 {
+	position_timer.setCallback([this]() { query_position(); });
+	snapshot_keys = {"pan_pos", "tilt_pos", "zoom_pos"};
 	set_config(data);
 	ptz_debug("pelco device created");
 }
@@ -161,6 +306,17 @@ void PTZPelco::set_config(OBSData config)
 	PelcoUART *ifc = PelcoUART::get_interface(uartt);
 	ifc->setConfig(config);
 	attach_interface(ifc);
+
+	/* Read the position back once for the new address */
+	position_unanswered = 0;
+	position_timer.start(500);
+}
+
+OBSData PTZPelco::get_settings()
+{
+	if (iface)
+		iface->writeStatistics(statistics);
+	return PTZDevice::get_settings();
 }
 
 OBSData PTZPelco::get_config()
@@ -227,7 +383,9 @@ void PTZPelco::do_update()
 
 	if (send_update) {
 		ptz_debug("pan %f, tilt %f, zoom %f, focus %f", pan_speed, tilt_speed, zoom_speed, focus_speed);
-		send(msg);
+		send(msg, address << 8 | PELCO_KEY_MOTION);
+		if (!position_timer.isActive())
+			position_timer.start(500);
 	}
 }
 
@@ -14,6 +14,7 @@
 #include <QStringListModel>
 #include <QtGlobal>
 #include "protocol-helpers.hpp"
+#include "timer-wheel.hpp"
 #include "uart-wrapper.hpp"
 
 /*
@@ -24,10 +25,35 @@ class PelcoUART : public PTZUARTWrapper {
 
 private:
 	static std::map<QString, PelcoUART *> interfaces;
-	const int messageLength = 8;
+
+	/*
+	 * Transmit scheduler. At low baud rates a frame takes tens of ms on the
+	 * wire, so frames are only handed to the UART once the previous one has
+	 * gone out. All frames go through one queue in the order they were
+	 * issued. A frame with a coalescing key (motion and speed updates)
+	 * replaces its pending predecessor in place, so operator input is never
+	 * more than one frame behind, unless a discrete command for the same
+	 * camera has been queued since. Then the new frame goes behind it.
+	 */
+	struct TxFrame {
+		int key;
+		QByteArray frame;
+	};
+	QList<TxFrame> tx_queue;
+	uint64_t line_free_ns = 0;
+	PTZTimer pace_timer;
+	uint64_t coalesced_count = 0;
+	uint64_t resync_count = 0;
+	uint64_t checksum_error_count = 0;
+	uint64_t wire_time_ns(int bytes);
+	void pump();
 
 public:
-	PelcoUART(QString &port_name) : PTZUARTWrapper(port_name) {}
+	static char checkSum(const QByteArray &data, bool pelco_d);
+
+	PelcoUART(QString &port_name);
+	void sendFrame(const QByteArray &frame, int coalesce_key = -1);
+	void writeStatistics(obs_data_t *data);
 	void receive_datagram(const QByteArray &packet);
 	void receiveBytes(const QByteArray &packet);
 
@@ -39,14 +65,20 @@ private:
 	bool use_pelco_d = false; // Flag that Pelco-D is used instead of Pelco-P
 	PelcoUART *iface;
 	void attach_interface(PelcoUART *new_iface);
-	char checkSum(QByteArray &data);
+
+	/* Position feedback (Pelco-D only). Cameras that never answer are
+	 * given up on after a few unanswered rounds */
+	static const int position_query_limit = 4;
+	PTZTimer position_timer;
+	int position_unanswered = 0;
+	void query_position();
 
 protected:
 	unsigned int address;
 
-	void send(const QByteArray &msg);
+	void send(const QByteArray &msg, int coalesce_key = -1);
 	void send(const unsigned char data_1, const unsigned char data_2, const unsigned char data_3,
-		  const unsigned char data_4);
+		  const unsigned char data_4, int coalesce_key = -1);
 	void focus_speed_set(double speed);
 	void zoom_speed_set(double speed);
 	void receive(const QByteArray &msg);
@@ -58,6 +90,7 @@ public:
 
 	void set_config(OBSData ptz_data);
 	OBSData get_config();
+	OBSData get_settings();
 	obs_properties_t *get_obs_properties();
 
 	void do_update();
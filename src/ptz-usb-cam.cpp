@@ -131,14 +131,9 @@ public:
 		std::string decoded_std_path = decoded_path.toStdString();
 		// blog(LOG_INFO, "PTZ-USB-CAM Device: %s", decoded_std_path.c_str());
 
-		HRESULT hr = CoInitialize(nullptr);
-		if (FAILED(hr) && hr != RPC_E_CHANGED_MODE) {
-			blog(LOG_ERROR, "Failed to initialize COM: %ld", hr);
-			return;
-		}
-
+		/* COM is initialized by the device strand's thread */
 		ICreateDevEnum *dev_enum = nullptr;
-		hr = CoCreateInstance(CLSID_SystemDeviceEnum, nullptr, CLSCTX_INPROC_SERVER, IID_ICreateDevEnum,
+		HRESULT hr = CoCreateInstance(CLSID_SystemDeviceEnum, nullptr, CLSCTX_INPROC_SERVER, IID_ICreateDevEnum,
 				      (void **)&dev_enum);
 		if (FAILED(hr)) {
 			blog(LOG_ERROR, "Failed to create device enumerator: %ld", hr);
@@ -293,6 +288,30 @@ void PTZUSBCam::ptz_tick_callback(void *param, float seconds)
 
 PTZUSBCam::PTZUSBCam(OBSData config) : PTZDevice(config)
 {
+#ifdef _WIN32
+	/* DirectShow objects belong to the COM apartment of the thread that
+	 * created them, so the control lives on a thread of its own that owns
+	 * the COM initialization for its whole lifetime */
+	strand = PTZStrand::createDedicated(
+		[this]() {
+			HRESULT hr = CoInitializeEx(nullptr, COINIT_APARTMENTTHREADED);
+			com_initialized = SUCCEEDED(hr);
+			if (!com_initialized)
+				blog(LOG_ERROR, "Failed to initialize COM: %ld", hr);
+		},
+		[this]() {
+			delete ptz_control_;
+			ptz_control_ = nullptr;
+			if (com_initialized)
+				CoUninitialize();
+		});
+#else
+	strand = PTZStrand::create();
+#endif
+	/* The strand keeps its own copy of the source name */
+	strand->post([this, name = objectName()]() { source_name = name; });
+	connect(this, &QObject::objectNameChanged, this,
+		[this](const QString &name) { strand->post([this, name]() { source_name = name; }); });
 	set_config(config);
 	obs_add_tick_callback(ptz_tick_callback, this);
 }
@@ -300,6 +319,8 @@ PTZUSBCam::PTZUSBCam(OBSData config) : PTZDevice(config)
 PTZUSBCam::~PTZUSBCam()
 {
 	obs_remove_tick_callback(ptz_tick_callback, this);
+	strand->close();
+	delete ptz_control_;
 }
 
 QString PTZUSBCam::description()
@@ -364,7 +385,7 @@ void PTZUSBCam::do_update()
 PTZControl *PTZUSBCam::get_ptz_control()
 {
 	std::string video_device_id = "";
-	OBSSourceAutoRelease src = obs_get_source_by_name(QT_TO_UTF8(objectName()));
+	OBSSourceAutoRelease src = obs_get_source_by_name(QT_TO_UTF8(source_name));
 	if (src) {
 		OBSDataAutoRelease psettings = obs_source_get_settings(src);
 		if (psettings) {
@@ -402,44 +423,63 @@ PTZControl *PTZUSBCam::get_ptz_control()
 	return ptz_control_;
 }
 
+/* Runs on the OBS graphics thread. The position update is handed to the
+ * device strand; a tick is skipped if the previous one hasn't been applied yet
+ * so that a slow ioctl can't build up a backlog */
 void PTZUSBCam::ptz_tick(float seconds)
 {
 	tick_elapsed += seconds;
-	if (tick_elapsed < 0.03f)
+	if (tick_elapsed < 0.03f || tick_queued)
 		return;
-	if (pan_speed != 0.0 || tilt_speed != 0.0) {
-		pantilt_rel(pan_speed * tick_elapsed, tilt_speed * tick_elapsed);
-	}
-	if (zoom_speed != 0.0) {
-		auto ptzctrl = get_ptz_control();
-		if (ptzctrl) {
-			zoom_abs(ptzctrl->getZoom() + zoom_speed * tick_elapsed);
-		}
-	}
-	if (focus_speed != 0.0) {
+	double pan = pan_speed * tick_elapsed;
+	double tilt = tilt_speed * tick_elapsed;
+	double zoom = zoom_speed * tick_elapsed;
+	double focus = focus_speed * tick_elapsed;
+	tick_elapsed = 0.0f;
+	if (pan == 0.0 && tilt == 0.0 && zoom == 0.0 && focus == 0.0)
+		return;
+
+	tick_queued = true;
+	strand->post([this, pan, tilt, zoom, focus]() {
+		tick_queued = false;
 		auto ptzctrl = get_ptz_control();
-		if (ptzctrl) {
-			focus_abs(ptzctrl->getFocus() + focus_speed * tick_elapsed);
+		if (!ptzctrl)
+			return;
+		if (pan != 0.0 || tilt != 0.0) {
+			ptzctrl->pan(ptzctrl->getPan() + pan);
+			ptzctrl->tilt(ptzctrl->getTilt() + tilt);
 		}
-	}
-	tick_elapsed = 0.0f;
+		if (zoom != 0.0)
+			ptzctrl->zoom(ptzctrl->getZoom() + zoom);
+		if (focus != 0.0)
+			ptzctrl->focus(ptzctrl->getFocus() + focus);
+	});
 }
 
+/*
+ * The public movement API is a thin proxy; the V4L2/DirectShow calls can block
+ * so they are all run in order on the device strand.
+ */
 void PTZUSBCam::pantilt_abs(double pan, double tilt)
 {
-	auto ptzctrl = get_ptz_control();
-	if (!ptzctrl)
-		return;
-	ptzctrl->pan(pan);
-	ptzctrl->tilt(tilt);
+	strand->post([this, pan, tilt]() {
+		auto ptzctrl = get_ptz_control();
+		if (!ptzctrl)
+			return;
+		ptzctrl->pan(pan);
+		ptzctrl->tilt(tilt);
+	});
 }
 
 void PTZUSBCam::pantilt_rel(double pan, double tilt)
 {
-	auto ptzctrl = get_ptz_control();
-	if (!ptzctrl)
-		return;
-	pantilt_abs(ptzctrl->getPan() + pan, ptzctrl->getTilt() + tilt);
+	strand->post([this, pan, tilt]() {
+		auto ptzctrl = get_ptz_control();
+		if (!ptzctrl)
+			return;
+		ptzctrl->pan(ptzctrl->getPan() + pan);
+		ptzctrl->tilt(ptzctrl->getTilt() + tilt);
+	});
 }
 
 void PTZUSBCam::pantilt_home()
@@ -449,26 +489,29 @@ void PTZUSBCam::pantilt_home()
 
 void PTZUSBCam::zoom_abs(double pos)
 {
-	auto ptzctrl = get_ptz_control();
-	if (!ptzctrl)
-		return;
-	ptzctrl->zoom(pos);
+	strand->post([this, pos]() {
+		auto ptzctrl = get_ptz_control();
+		if (ptzctrl)
+			ptzctrl->zoom(pos);
+	});
 }
 
 void PTZUSBCam::focus_abs(double pos)
 {
-	auto ptzctrl = get_ptz_control();
-	if (!ptzctrl)
-		return;
-	ptzctrl->focus(pos);
+	strand->post([this, pos]() {
+		auto ptzctrl = get_ptz_control();
+		if (ptzctrl)
+			ptzctrl->focus(pos);
+	});
 }
 
 void PTZUSBCam::set_autofocus(bool enabled)
 {
-	auto ptzctrl = get_ptz_control();
-	if (!ptzctrl)
-		return;
-	ptzctrl->setAutoFocus(enabled);
+	strand->post([this, enabled]() {
+		auto ptzctrl = get_ptz_control();
+		if (ptzctrl)
+			ptzctrl->setAutoFocus(enabled);
+	});
 }
 
 void PTZUSBCam::memory_reset(int i)
@@ -480,10 +523,13 @@ void PTZUSBCam::memory_reset(int i)
 
 void PTZUSBCam::memory_set(int i)
 {
-	auto ptzctrl = get_ptz_control();
-	if (!ptzctrl)
-		return;
-	presets[i] = ptzctrl->getPosition();
+	strand->post([this, i]() {
+		auto ptzctrl = get_ptz_control();
+		if (!ptzctrl)
+			return;
+		auto pos = ptzctrl->getPosition();
+		QMetaObject::invokeMethod(this, [this, i, pos]() { presets[i] = pos; }, Qt::QueuedConnection);
+	});
 }
 
 void PTZUSBCam::memory_recall(int i)
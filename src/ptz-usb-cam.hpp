@@ -6,6 +6,7 @@
 	*/
 #pragma once
 
+#include <atomic>
 #include <QObject>
 #include <QTcpSocket>
 #include "ptz-device.hpp"
@@ -85,7 +86,13 @@ private:
 	QString m_PTZAddress{""};
 	QMap<int, PtzUsbCamPos> presets;
 	double tick_elapsed = 0.0f;
+	std::atomic<bool> tick_queued{false};
+	/* Only accessed from the device strand */
 	PTZControl *ptz_control_ = nullptr;
+	QString source_name;
+#ifdef _WIN32
+	bool com_initialized = false;
+#endif
 	PTZControl *get_ptz_control();
 
 protected:
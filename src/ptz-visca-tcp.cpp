@@ -5,16 +5,38 @@
  * SPDX-License-Identifier: GPLv2
  */
 
+#include <QRandomGenerator>
 #include <qt-wrappers.hpp>
 #include "ptz-visca-tcp.hpp"
 
-PTZViscaOverTCP::PTZViscaOverTCP(OBSData config) : PTZVisca(config)
+PTZViscaOverTCP::PTZViscaOverTCP(OBSData config) : PTZVisca(config), visca_socket(new QTcpSocket())
 {
 	address = 1;
+	reconnect_timer.setSingleShot(true);
+	reconnect_timer.setCallback([this]() { connectSocket(); });
+
+	channel = PTZIOChannel::create(this, visca_socket);
+	channel->transmit = [sock = visca_socket](PTZIOFrame &frame) {
+		sock->write(frame.data);
+	};
+	channel->receive = [this](PTZIOFrame &frame) {
+		receive_datagram(frame.data);
+	};
+	connect(visca_socket, &QTcpSocket::readyRead, visca_socket, [this]() { poll(); });
+	connect(visca_socket, &QTcpSocket::stateChanged, this, &PTZViscaOverTCP::on_socket_stateChanged);
+	/* Socket options only stick once the socket engine exists, and every
+	 * connection attempt creates a new one */
+	connect(visca_socket, &QTcpSocket::connected, visca_socket,
+		[sock = visca_socket]() { setSocketOptions(sock); });
+	visca_socket->moveToThread(ptz_io_thread());
+	applySocketOptions();
+
 	set_config(config);
-	visca_socket.setSocketOption(QAbstractSocket::KeepAliveOption, 1);
-	connect(&visca_socket, &QTcpSocket::readyRead, this, &PTZViscaOverTCP::poll);
-	connect(&visca_socket, &QTcpSocket::stateChanged, this, &PTZViscaOverTCP::on_socket_stateChanged);
+}
+
+PTZViscaOverTCP::~PTZViscaOverTCP()
+{
+	ptz_io_release(visca_socket);
 }
 
 QString PTZViscaOverTCP::description()
@@ -27,19 +49,71 @@ void PTZViscaOverTCP::reset()
 	cmd_get_camera_info();
 }
 
+/* In low latency mode Nagle is disabled and all frames queued in one I/O
+ * thread wakeup are coalesced into a single write, so each event loop turn
+ * results in at most one segment on the wire */
+void PTZViscaOverTCP::applySocketOptions()
+{
+	/* The channel's transmit hooks are only touched on the I/O thread, where
+	 * flush() calls them */
+	ptz_io_invoke(visca_socket, [sock = visca_socket, chan = channel, nodelay = low_latency]() {
+		if (nodelay) {
+			chan->transmit_batch = [sock](std::vector<PTZIOFrame> &frames) {
+				QByteArray buf;
+				for (auto &frame : frames)
+					buf += frame.data;
+				sock->write(buf);
+			};
+		} else {
+			chan->transmit_batch = nullptr;
+		}
+		sock->setProperty("ptz_low_delay", nodelay);
+		if (sock->state() == QAbstractSocket::ConnectedState)
+			setSocketOptions(sock);
+	});
+}
+
+/* Must be called on the I/O thread with the socket connected */
+void PTZViscaOverTCP::setSocketOptions(QTcpSocket *sock)
+{
+	sock->setSocketOption(QAbstractSocket::KeepAliveOption, 1);
+	sock->setSocketOption(QAbstractSocket::LowDelayOption, sock->property("ptz_low_delay").toBool() ? 1 : 0);
+}
+
 void PTZViscaOverTCP::connectSocket()
 {
-	visca_socket.connectToHost(host, port);
+	if (connecting || socket_state != QAbstractSocket::UnconnectedState)
+		return;
+	reconnect_timer.stop();
+	connecting = true;
+	connect_start_ns = os_gettime_ns();
+	ptz_io_invoke(visca_socket, [sock = visca_socket, h = host, p = port]() { sock->connectToHost(h, p); });
 }
 
 void PTZViscaOverTCP::on_socket_stateChanged(QAbstractSocket::SocketState state)
 {
+	auto prev_state = socket_state;
+	socket_state = state;
 	switch (state) {
-	case QAbstractSocket::UnconnectedState:
-		/* Attempt reconnection periodically */
-		QTimer::singleShot(1900, this, SLOT(connectSocket()));
+	case QAbstractSocket::UnconnectedState: {
+		connecting = false;
+		/* Nothing to reconnect to, or a retry is already pending */
+		if (prev_state == QAbstractSocket::UnconnectedState || host.isEmpty() || reconnect_timer.isActive())
+			break;
+		/* Attempt reconnection with exponential backoff and +/-25% jitter
+		 * so a room full of cameras doesn't retry in lock step */
+		int jitter = reconnect_delay_ms / 4;
+		int delay = reconnect_delay_ms + QRandomGenerator::global()->bounded(-jitter, jitter + 1);
+		reconnect_timer.start(delay);
+		reconnect_delay_ms = std::min(reconnect_delay_ms * 2, reconnect_max_ms);
+		incrementStatistic("visca_tcp_reconnect_count");
 		break;
+	}
 	case QAbstractSocket::ConnectedState:
+		connecting = false;
+		reconnect_delay_ms = reconnect_min_ms;
+		obs_data_set_double(statistics, "visca_tcp_connect_ms", (os_gettime_ns() - connect_start_ns) / 1000000.0);
+		incrementStatistic("visca_tcp_connect_count");
 		blog(LOG_INFO, "VISCA_over_TCP %s connected", QT_TO_UTF8(objectName()));
 		reset();
 		break;
@@ -50,9 +124,12 @@ void PTZViscaOverTCP::on_socket_stateChanged(QAbstractSocket::SocketState state)
 
 void PTZViscaOverTCP::send_immediate(const QByteArray &msg)
 {
-	if (visca_socket.state() == QAbstractSocket::UnconnectedState)
+	/* Don't cut a reconnect backoff short */
+	if (socket_state == QAbstractSocket::UnconnectedState && !reconnect_timer.isActive())
 		connectSocket();
-	visca_socket.write(msg);
+	PTZIOFrame frame;
+	frame.data = msg;
+	channel->send(std::move(frame));
 }
 
 void PTZViscaOverTCP::receive_datagram(const QByteArray &packet)
@@ -80,13 +157,16 @@ void PTZViscaOverTCP::receive_datagram(const QByteArray &packet)
 	receive(packet);
 }
 
+/* Runs on the I/O thread. Splits the stream into VISCA frames and hands each
+ * complete frame to the UI thread */
 void PTZViscaOverTCP::poll()
 {
-	for (auto b : visca_socket.readAll()) {
+	for (auto b : visca_socket->readAll()) {
 		rxbuffer += b;
 		if ((b & 0xff) == 0xff) {
-			if (rxbuffer.size())
-				receive_datagram(rxbuffer);
+			PTZIOFrame frame;
+			frame.data = rxbuffer;
+			channel->post(std::move(frame));
 			rxbuffer.clear();
 		}
 	}
@@ -95,11 +175,28 @@ void PTZViscaOverTCP::poll()
 void PTZViscaOverTCP::set_config(OBSData config)
 {
 	PTZVisca::set_config(config);
-	host = obs_data_get_string(config, "host");
-	port = (int)obs_data_get_int(config, "port");
-	if (!port)
-		port = 5678;
-	connectSocket();
+	QString new_host = obs_data_get_string(config, "host");
+	int new_port = (int)obs_data_get_int(config, "port");
+	if (!new_port)
+		new_port = 5678;
+	bool new_low_latency = obs_data_get_bool(config, "low_latency");
+	if (new_low_latency != low_latency) {
+		low_latency = new_low_latency;
+		applySocketOptions();
+	}
+
+	/* Only (re)connect when the endpoint actually changed */
+	if (new_host == host && new_port == port)
+		return;
+	host = new_host;
+	port = new_port;
+	reconnect_delay_ms = reconnect_min_ms;
+	if (socket_state != QAbstractSocket::UnconnectedState || connecting) {
+		/* The Unconnected state change schedules the reconnect */
+		ptz_io_invoke(visca_socket, [sock = visca_socket]() { sock->abort(); });
+		return;
+	}
+	ptzDeviceList.bring_up(this, "host:" + host, [this]() { connectSocket(); }, true);
 }
 
 OBSData PTZViscaOverTCP::get_config()
@@ -107,9 +204,16 @@ OBSData PTZViscaOverTCP::get_config()
 	OBSData config = PTZVisca::get_config();
 	obs_data_set_string(config, "host", QT_TO_UTF8(host));
 	obs_data_set_int(config, "port", port);
+	obs_data_set_bool(config, "low_latency", low_latency);
 	return config;
 }
 
+OBSData PTZViscaOverTCP::get_settings()
+{
+	channel->writeStatistics(statistics);
+	return PTZVisca::get_settings();
+}
+
 obs_properties_t *PTZViscaOverTCP::get_obs_properties()
 {
 	obs_properties_t *ptz_props = PTZVisca::get_obs_properties();
@@ -118,5 +222,6 @@ obs_properties_t *PTZViscaOverTCP::get_obs_properties()
 	obs_property_set_description(p, "VISCA (TCP) Connection");
 	obs_properties_add_text(config, "host", "IP Host", OBS_TEXT_DEFAULT);
 	obs_properties_add_int(config, "port", "TCP port", 1, 65535, 1);
+	obs_properties_add_bool(config, "low_latency", "Low latency (disable Nagle, coalesce writes)");
 	return ptz_props;
 }
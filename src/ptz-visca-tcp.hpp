@@ -8,19 +8,35 @@
 
 #include <QObject>
 #include <QTcpSocket>
+#include "io-thread.hpp"
 #include "ptz-visca.hpp"
 
 class PTZViscaOverTCP : public PTZVisca {
 	Q_OBJECT
 
 private:
-	QTcpSocket visca_socket;
-	QByteArray rxbuffer;
+	QTcpSocket *visca_socket; /* Lives on the I/O thread */
+	QAbstractSocket::SocketState socket_state = QAbstractSocket::UnconnectedState;
+	std::shared_ptr<PTZIOChannel> channel;
+	QByteArray rxbuffer; /* Only accessed from the I/O thread */
 	QString host;
-	int port;
+	int port = 0;
+	bool low_latency = false;
+	PTZTimer reconnect_timer;
+
+	/* Reconnection uses exponential backoff with jitter */
+	static const int reconnect_min_ms = 250;
+	static const int reconnect_max_ms = 30000;
+	int reconnect_delay_ms = reconnect_min_ms;
+	bool connecting = false;
+	uint64_t connect_start_ns = 0;
+
+	void applySocketOptions();
+	static void setSocketOptions(QTcpSocket *sock);
 
 protected:
 	void send_immediate(const QByteArray &msg);
+	bool flush_receive() { return channel->drain(); }
 	void reset();
 	void receive_datagram(const QByteArray &packet);
 	void poll();
@@ -31,9 +47,11 @@ private slots:
 
 public:
 	PTZViscaOverTCP(OBSData config);
+	~PTZViscaOverTCP();
 	virtual QString description();
 
 	void set_config(OBSData ptz_data);
 	OBSData get_config();
+	OBSData get_settings();
 	obs_properties_t *get_obs_properties();
 };
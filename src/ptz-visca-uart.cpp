@@ -17,18 +17,16 @@ ViscaUART::ViscaUART(QString &port_name) : PTZUARTWrapper(port_name)
 	camera_count = 0;
 }
 
-bool ViscaUART::open()
+/* Cameras may have been power cycled or rearranged while the adapter was
+ * away, so re-enumerate the bus every time the port comes up */
+void ViscaUART::opened()
 {
 	camera_count = 0;
-	bool rc = PTZUARTWrapper::open();
-	if (rc)
-		send(VISCA_ENUMERATE.cmd);
-	return rc;
+	send(VISCA_ENUMERATE.cmd);
 }
 
-void ViscaUART::close()
+void ViscaUART::closed()
 {
-	PTZUARTWrapper::close();
 	camera_count = 0;
 }
 
@@ -40,7 +38,7 @@ void ViscaUART::receive_datagram(const QByteArray &packet)
 		switch (packet[1] & 0x0f) { /* Decode Packet Socket Field */
 		case 0:
 			camera_count = (packet[2] & 0x7) - 1;
-			blog(LOG_INFO, "VISCA Interface %s: %i camera%s found", qPrintable(uart.portName()),
+			blog(LOG_INFO, "VISCA Interface %s: %i camera%s found", qPrintable(port_name),
 			     camera_count, camera_count == 1 ? "" : "s");
 			send(VISCA_IF_CLEAR.cmd);
 			emit reset();
@@ -81,7 +79,6 @@ ViscaUART *ViscaUART::get_interface(QString port_name)
 	if (!iface) {
 		blog(LOG_DEBUG, "Creating new VISCA object %s", qPrintable(port_name));
 		iface = new ViscaUART(port_name);
-		iface->open();
 		interfaces[port_name] = iface;
 	}
 	return iface;
@@ -115,7 +112,9 @@ void PTZViscaSerial::attach_interface(ViscaUART *new_iface)
 
 void PTZViscaSerial::reset()
 {
-	cmd_get_camera_info();
+	/* All cameras on a bus are reset together after enumeration; space out
+	 * the inquiry sweeps so they don't saturate the UART */
+	ptzDeviceList.bring_up(this, "serial:" + iface->portName(), [this]() { cmd_get_camera_info(); });
 }
 
 void PTZViscaSerial::send_immediate(const QByteArray &msg_)
@@ -138,6 +137,13 @@ void PTZViscaSerial::set_config(OBSData config)
 	attach_interface(iface);
 }
 
+OBSData PTZViscaSerial::get_settings()
+{
+	if (iface)
+		iface->writeStatistics(statistics);
+	return PTZVisca::get_settings();
+}
+
 OBSData PTZViscaSerial::get_config()
 {
 	OBSData config = PTZVisca::get_config();
@@ -19,10 +19,12 @@ private:
 
 	int camera_count;
 
+protected:
+	void opened();
+	void closed();
+
 public:
 	ViscaUART(QString &port_name);
-	bool open();
-	void close();
 	void receive_datagram(const QByteArray &packet);
 	void receiveBytes(const QByteArray &packet);
 
@@ -38,6 +40,7 @@ private:
 
 protected:
 	void send_immediate(const QByteArray &msg);
+	bool flush_receive() { return iface ? iface->flush_receive() : false; }
 	void reset();
 
 public:
@@ -47,5 +50,6 @@ public:
 
 	void set_config(OBSData ptz_data);
 	OBSData get_config();
+	OBSData get_settings();
 	obs_properties_t *get_obs_properties();
 };
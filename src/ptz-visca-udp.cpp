@@ -5,6 +5,7 @@
  * SPDX-License-Identifier: GPLv2
  */
 
+#include <cstring>
 #include <QHostInfo>
 #include <QNetworkDatagram>
 #include "ptz-visca-udp.hpp"
@@ -13,26 +14,131 @@ std::map<int, ViscaUDPSocket *> ViscaUDPSocket::interfaces;
 
 ViscaUDPSocket::ViscaUDPSocket(int port) : visca_port(port)
 {
-	if (!visca_socket.bind(QHostAddress::Any, visca_port)) {
-		blog(LOG_INFO, "VISCA-over-IP bind to port %i failed", visca_port);
+	open(QHostAddress(), 0);
+}
+
+/* Dedicated socket for a single camera, connected to `peer` from an ephemeral
+ * local port and serviced by one of the I/O thread shards */
+ViscaUDPSocket::ViscaUDPSocket(const QHostAddress &peer, int port, int shard) : visca_port(port), peer(peer)
+{
+	open(peer, shard);
+}
+
+void ViscaUDPSocket::open(const QHostAddress &peer, int shard)
+{
+	int port = visca_port;
+#if defined(__linux__)
+	batch_socket = new PTZUDPBatchSocket();
+	if (peer.isNull() ? batch_socket->bind(visca_port) : batch_socket->connectTo(peer, visca_port)) {
+		channel = PTZIOChannel::create(this, batch_socket);
+		channel->transmit_batch = [sock = batch_socket, port](std::vector<PTZIOFrame> &frames) {
+			sock->send(frames, port);
+		};
+		channel->receive = [this](PTZIOFrame &frame) { deliver(frame); };
+		batch_socket->receive = [ch = channel](PTZIOFrame &&frame) { ch->post(std::move(frame)); };
+		batch_socket->moveToThread(ptz_io_thread(shard));
 		return;
 	}
-	connect(&visca_socket, &QUdpSocket::readyRead, this, &ViscaUDPSocket::poll);
+	blog(LOG_INFO, "VISCA-over-IP native socket on port %i unavailable, using QUdpSocket", visca_port);
+	delete batch_socket;
+	batch_socket = nullptr;
+#endif
+
+	visca_socket = new QUdpSocket();
+	channel = PTZIOChannel::create(this, visca_socket);
+	channel->receive = [this](PTZIOFrame &frame) { deliver(frame); };
+	if (peer.isNull()) {
+		channel->transmit = [sock = visca_socket, port](PTZIOFrame &frame) {
+			sock->writeDatagram(frame.data, frame.address, port);
+		};
+		if (visca_socket->bind(QHostAddress::Any, visca_port))
+			connect(visca_socket, &QUdpSocket::readyRead, visca_socket, [this]() { poll(); });
+		else
+			blog(LOG_INFO, "VISCA-over-IP bind to port %i failed", visca_port);
+	} else {
+		channel->transmit = [sock = visca_socket](PTZIOFrame &frame) { sock->write(frame.data); };
+		connect(visca_socket, &QUdpSocket::readyRead, visca_socket, [this]() { poll(); });
+		visca_socket->connectToHost(peer, visca_port);
+	}
+	visca_socket->moveToThread(ptz_io_thread(shard));
+}
+
+ViscaUDPSocket::~ViscaUDPSocket()
+{
+#if defined(__linux__)
+	if (batch_socket) {
+		ptz_io_release(batch_socket);
+		return;
+	}
+#endif
+	ptz_io_release(visca_socket);
+}
+
+void ViscaUDPSocket::attach(PTZViscaOverIP *ptz, const QHostAddress &address)
+{
+	detach(ptz);
+	if (address.isNull())
+		return;
+	devices.insert(qMakePair(address, (quint16)visca_port), ptz);
+	devices_by_address.insert(address, ptz);
+	device_addresses.insert(ptz, address);
+}
+
+void ViscaUDPSocket::detach(PTZViscaOverIP *ptz)
+{
+	auto it = device_addresses.find(ptz);
+	if (it == device_addresses.end())
+		return;
+	auto key = qMakePair(it.value(), (quint16)visca_port);
+	if (devices.value(key) == ptz)
+		devices.remove(key);
+	if (devices_by_address.value(it.value()) == ptz)
+		devices_by_address.remove(it.value());
+	device_addresses.erase(it);
 }
 
-void PTZViscaOverIP::receive_datagram(const QNetworkDatagram &dg)
+void ViscaUDPSocket::deliver(PTZIOFrame &frame)
 {
-	if (!dg.senderAddress().isEqual(ip_address)) // Check if this packet is for us.
+	PTZViscaOverIP *ptz = devices.value(qMakePair(frame.address, frame.port));
+	if (!ptz)
+		ptz = devices_by_address.value(peer.isNull() ? frame.address : peer);
+	if (!ptz) {
+		unknown_sender_count++;
 		return;
+	}
+	ptz->receive_datagram(frame.data);
+}
 
-	QByteArray data = dg.data();
+void PTZViscaOverIP::receive_datagram(const QByteArray &datagram)
+{
+	QByteArray data = datagram;
 	if (quirk_visca_udp_no_seq) {
 		// Prepend an empty sequence field
 		int s = data.size();
-		data = QByteArray::fromHex("0111000000000000") + dg.data();
+		data = QByteArray::fromHex("0111000000000000") + datagram;
 		data[3] = s;
 	}
-	if (data.size() < 9) {
+	process_datagram(data);
+}
+
+bool PTZViscaOverIP::is_duplicate(uint32_t seq, uint8_t reply)
+{
+	uint64_t key = (uint64_t)seq << 8 | reply;
+	for (auto k : recent_replies)
+		if (k == key)
+			return true;
+	return false;
+}
+
+void PTZViscaOverIP::remember_reply(uint32_t seq, uint8_t reply)
+{
+	recent_replies[recent_pos] = (uint64_t)seq << 8 | reply;
+	recent_pos = (recent_pos + 1) % recent_size;
+}
+
+void PTZViscaOverIP::process_datagram(const QByteArray &data)
+{
+	if (data.size() < 10) {
 		ptz_debug("VISCA UDP (too small) <-- %s", qPrintable(data.toHex(':')));
 		return;
 	}
@@ -48,8 +154,16 @@ void PTZViscaOverIP::receive_datagram(const QNetworkDatagram &dg)
 		return;
 	}
 
+	/* Without sequence numbers there is nothing to dedup or reorder */
+	bool sequenced = !quirk_visca_udp_no_seq;
+
 	switch (type) {
 	case 0x0111:
+		/* The camera may answer both the original and a retransmit */
+		if (sequenced && is_duplicate(seq, data[9])) {
+			incrementStatistic("visca_udp_duplicate_count");
+			return;
+		}
 		switch (reply_code) {
 		case 0x40:
 			if (seq != seq_state[0]) {
@@ -61,7 +175,15 @@ void PTZViscaOverIP::receive_datagram(const QNetworkDatagram &dg)
 			seq_state[slot] = seq_state[0];
 			break;
 		case 0x50:
+		case 0x60:
 			if (seq != seq_state[slot]) {
+				/* Completion overtook the ACK that assigns its slot;
+				 * hold it until the ACK arrives */
+				if (sequenced && slot != 0 && seq == seq_state[0] && held_replies.size() < reorder_window) {
+					held_replies.append(data);
+					incrementStatistic("visca_udp_reordered_count");
+					return;
+				}
 				blog(LOG_DEBUG, "VISCA UDP (out of seq %i != %i) <-- %s", seq, seq_state[0],
 				     qPrintable(data.toHex(':')));
 				incrementStatistic("visca_udp_outofseq_cmplt_count");
@@ -73,12 +195,23 @@ void PTZViscaOverIP::receive_datagram(const QNetworkDatagram &dg)
 			incrementStatistic("visca_udp_unknown_count");
 			return;
 		}
+		if (sequenced)
+			remember_reply(seq, data[9]);
+		resync_attempts = 0;
 		receive(data.mid(8, size));
+
+		/* Release any completions that were waiting on this ACK */
+		if (reply_code == 0x40 && !held_replies.isEmpty()) {
+			auto held = held_replies;
+			held_replies.clear();
+			for (auto &reply : held)
+				process_datagram(reply);
+		}
 		break;
 	case 0x0200:
 	case 0x0201: /* Check for sequence number out of sync */
 		if (data[8] == (char)0x0f && data[8 + 1] == (char)1)
-			reset();
+			resync();
 		break;
 	default:
 		blog(LOG_DEBUG, "VISCA UDP unrecognized type: %x", type);
@@ -87,13 +220,23 @@ void PTZViscaOverIP::receive_datagram(const QNetworkDatagram &dg)
 
 void ViscaUDPSocket::send(QHostAddress ip_address, const QByteArray &packet)
 {
-	visca_socket.writeDatagram(packet, ip_address, visca_port);
+	PTZIOFrame frame;
+	frame.data = packet;
+	frame.address = ip_address;
+	channel->send(std::move(frame));
 }
 
+/* Runs on the I/O thread */
 void ViscaUDPSocket::poll()
 {
-	while (visca_socket.hasPendingDatagrams())
-		emit receive_datagram(visca_socket.receiveDatagram());
+	while (visca_socket->hasPendingDatagrams()) {
+		QNetworkDatagram dg = visca_socket->receiveDatagram();
+		PTZIOFrame frame;
+		frame.data = dg.data();
+		frame.address = dg.senderAddress();
+		frame.port = (quint16)dg.senderPort();
+		channel->post(std::move(frame));
+	}
 }
 
 ViscaUDPSocket *ViscaUDPSocket::get_interface(int port)
@@ -118,51 +261,123 @@ PTZViscaOverIP::PTZViscaOverIP(OBSData config) : PTZVisca(config), iface(NULL)
 PTZViscaOverIP::~PTZViscaOverIP()
 {
 	attach_interface(nullptr);
+	delete own_iface;
 }
 
 QString PTZViscaOverIP::description()
 {
-	return QString("VISCA/UDP %1:%2").arg(ip_address.toString(), QString::number(iface->port()));
+	return QString("VISCA/UDP %1:%2").arg(ip_address.toString(), QString::number(udp_port));
 }
 
 void PTZViscaOverIP::attach_interface(ViscaUDPSocket *new_iface)
 {
 	if (iface)
-		iface->disconnect(this);
+		iface->detach(this);
 	iface = new_iface;
 	if (iface) {
-		connect(iface, SIGNAL(receive_datagram(QNetworkDatagram)), this,
-			SLOT(receive_datagram(QNetworkDatagram)));
+		iface->attach(this, ip_address);
 		reset();
 	}
 }
 
-void PTZViscaOverIP::reset()
+void PTZViscaOverIP::update_interface()
+{
+	if (!dedicated_socket) {
+		attach_interface(ViscaUDPSocket::get_interface(udp_port));
+		delete own_iface;
+		own_iface = nullptr;
+		return;
+	}
+
+	/* A dedicated socket is connected to the camera, so it can only be
+	 * created once the address is known */
+	ViscaUDPSocket *old_iface = own_iface;
+	if (ip_address.isNull()) {
+		own_iface = nullptr;
+	} else if (!own_iface || own_iface->peerAddress() != ip_address || own_iface->port() != udp_port) {
+		static int next_shard = 0;
+		own_iface = new ViscaUDPSocket(ip_address, udp_port, ++next_shard);
+	}
+	attach_interface(own_iface);
+	if (old_iface != own_iface)
+		delete old_iface;
+}
+
+void PTZViscaOverIP::reset_sequence()
 {
 	for (int i = 0; i < 8; i++)
 		seq_state[i] = 0;
-	incrementStatistic("visca_udp_reset_count");
+	/* Sequence numbers restart, so old replies are no longer duplicates */
+	for (auto &k : recent_replies)
+		k = 0;
+	held_replies.clear();
 	iface->send(ip_address, QByteArray::fromHex("020000010000000001"));
+}
+
+void PTZViscaOverIP::reset()
+{
+	/* Nothing to talk to until the host lookup completes */
+	if (ip_address.isNull() || !iface)
+		return;
+	incrementStatistic("visca_udp_reset_count");
+	reset_sequence();
 	cmd_get_camera_info();
 }
 
+/* The camera reported a sequence error. Resetting the sequence counter is
+ * usually enough; the active command is retransmitted by the normal timeout
+ * path. Only when that keeps failing fall back to a full resync which
+ * re-inquires all camera state. */
+void PTZViscaOverIP::resync()
+{
+	if (ip_address.isNull() || !iface)
+		return;
+	if (++resync_attempts <= max_sequence_resets) {
+		incrementStatistic("visca_udp_seq_reset_count");
+		reset_sequence();
+		return;
+	}
+	resync_attempts = 0;
+	incrementStatistic("visca_udp_resync_count");
+	reset();
+}
+
+bool PTZViscaOverIP::flush_receive()
+{
+	return iface ? iface->flush_receive() : false;
+}
+
 void PTZViscaOverIP::send_immediate(const QByteArray &msg)
 {
+	if (!iface)
+		return;
 	if (quirk_visca_udp_no_seq) {
 		// Don't prepend the sequence field
 		iface->send(ip_address, msg);
 		incrementStatistic("visca_udp_sent_count");
 		return;
 	}
-	QByteArray p = QByteArray::fromHex("0100000000000000") + msg;
-	seq_state[0]++;
-	p[1] = (0x9 == msg[1]) ? 0x10 : 0x00;
-	p[3] = msg.size();
-	p[4] = (seq_state[0] >> 24) & 0xff;
-	p[5] = (seq_state[0] >> 16) & 0xff;
-	p[6] = (seq_state[0] >> 8) & 0xff;
-	p[7] = seq_state[0] & 0xff;
-	p[8] = '\x81';
+	/* Build the VISCA-over-IP header in place. A retransmit reuses the
+	 * sequence number so a late reply to the original still matches, and
+	 * the duplicate reply is suppressed */
+	QByteArray p(8 + msg.size(), Qt::Uninitialized);
+	char *h = p.data();
+	if (retransmitting) {
+		incrementStatistic("visca_udp_retransmit_count");
+	} else {
+		seq_state[0]++;
+		held_replies.clear();
+	}
+	h[0] = 0x01;
+	h[1] = (0x9 == msg[1]) ? 0x10 : 0x00;
+	h[2] = (msg.size() >> 8) & 0xff;
+	h[3] = msg.size() & 0xff;
+	h[4] = (seq_state[0] >> 24) & 0xff;
+	h[5] = (seq_state[0] >> 16) & 0xff;
+	h[6] = (seq_state[0] >> 8) & 0xff;
+	h[7] = seq_state[0] & 0xff;
+	memcpy(h + 8, msg.constData(), msg.size());
+	h[8] = '\x81';
 	iface->send(ip_address, p);
 	incrementStatistic("visca_udp_sent_count");
 }
@@ -172,6 +387,12 @@ void PTZViscaOverIP::lookup_host_callback(const QHostInfo info)
 	auto new_addr = info.addresses().first();
 	if (new_addr != ip_address) {
 		ip_address = new_addr;
+		if (dedicated_socket) {
+			update_interface();
+			return;
+		}
+		if (iface)
+			iface->attach(this, ip_address);
 		reset();
 	}
 }
@@ -183,15 +404,25 @@ void PTZViscaOverIP::set_config(OBSData config)
 	if (new_host.isEmpty())
 		new_host = obs_data_get_string(config, "address");
 	auto port = obs_data_get_int(config, "port");
+	if (!port)
+		port = 52381;
+	udp_port = (int)port;
+	dedicated_socket = obs_data_get_bool(config, "dedicated_socket");
 	if (new_host != host) {
 		ip_address.clear();
+		if (iface)
+			iface->detach(this);
 		host = new_host;
+		/* Space out cameras sharing a socket; a dedicated socket only
+		 * contends with other connections to the same camera */
+		QString resource = dedicated_socket ? "host:" + host : "visca-udp:" + QString::number(udp_port);
 		if (!host.isEmpty())
-			QHostInfo::lookupHost(host, this, SLOT(lookup_host_callback(QHostInfo)));
+			ptzDeviceList.bring_up(
+				this, resource,
+				[this]() { QHostInfo::lookupHost(host, this, SLOT(lookup_host_callback(QHostInfo))); },
+				true);
 	}
-	if (!port)
-		port = 52381;
-	attach_interface(ViscaUDPSocket::get_interface(port));
+	update_interface();
 	quirk_visca_udp_no_seq = obs_data_get_bool(config, "quirk_visca_udp_no_seq");
 }
 
@@ -200,11 +431,20 @@ OBSData PTZViscaOverIP::get_config()
 	OBSData config = PTZVisca::get_config();
 	obs_data_set_string(config, "host", qPrintable(host));
 	obs_data_set_string(config, "address", qPrintable(ip_address.toString()));
-	obs_data_set_int(config, "port", iface->port());
+	obs_data_set_int(config, "port", udp_port);
+	obs_data_set_bool(config, "dedicated_socket", dedicated_socket);
 	obs_data_set_bool(config, "quirk_visca_udp_no_seq", quirk_visca_udp_no_seq);
 	return config;
 }
 
+OBSData PTZViscaOverIP::get_settings()
+{
+	obs_data_set_int(statistics, "visca_udp_unknown_sender_count", iface ? iface->unknownSenderCount() : 0);
+	if (iface)
+		iface->writeStatistics(statistics);
+	return PTZVisca::get_settings();
+}
+
 obs_properties_t *PTZViscaOverIP::get_obs_properties()
 {
 	obs_properties_t *ptz_props = PTZVisca::get_obs_properties();
@@ -213,6 +453,7 @@ obs_properties_t *PTZViscaOverIP::get_obs_properties()
 	obs_property_set_description(p, "VISCA (UDP) Connection");
 	obs_properties_add_text(config, "host", "Host name or IP Address", OBS_TEXT_DEFAULT);
 	obs_properties_add_int(config, "port", "UDP port", 1, 65535, 1);
+	obs_properties_add_bool(config, "dedicated_socket", "Use a dedicated socket for this camera");
 	obs_properties_add_bool(config, "quirk_visca_udp_no_seq", "Don't use sequence numbers");
 	return ptz_props;
 }
@@ -7,9 +7,16 @@
 #pragma once
 
 #include <QObject>
+#include <QHash>
 #include <QHostInfo>
 #include <QUdpSocket>
+#include "io-thread.hpp"
 #include "ptz-visca.hpp"
+#if defined(__linux__)
+#include "udp-batch.hpp"
+#endif
+
+class PTZViscaOverIP;
 
 class ViscaUDPSocket : public QObject {
 	Q_OBJECT
@@ -19,20 +26,41 @@ private:
 	static std::map<int, ViscaUDPSocket *> interfaces;
 
 	int visca_port;
-	QUdpSocket visca_socket;
+	QHostAddress peer; /* Set for a dedicated per-camera socket */
+	/* Both live on the I/O thread. The native batched socket is used where
+	 * available, otherwise QUdpSocket is the portable fallback. */
+	QUdpSocket *visca_socket = nullptr;
+#if defined(__linux__)
+	PTZUDPBatchSocket *batch_socket = nullptr;
+#endif
+	std::shared_ptr<PTZIOChannel> channel;
+
+	/* Datagrams are demultiplexed by sender. Cameras normally reply from
+	 * the VISCA port, but some use an ephemeral source port, so fall back
+	 * to matching on the address alone. */
+	QHash<QPair<QHostAddress, quint16>, PTZViscaOverIP *> devices;
+	QHash<QHostAddress, PTZViscaOverIP *> devices_by_address;
+	QHash<PTZViscaOverIP *, QHostAddress> device_addresses;
+	uint64_t unknown_sender_count = 0;
 
-signals:
-	void receive_datagram(const QNetworkDatagram &dg);
+	void open(const QHostAddress &peer, int shard);
+	void poll();
+	void deliver(PTZIOFrame &frame);
 
 public:
 	ViscaUDPSocket(int port = 52381);
+	ViscaUDPSocket(const QHostAddress &peer, int port, int shard);
+	~ViscaUDPSocket();
 	void send(QHostAddress ip_address, const QByteArray &packet);
+	bool flush_receive() { return channel->drain(); }
 	int port() { return visca_port; }
+	QHostAddress peerAddress() { return peer; }
+	void attach(PTZViscaOverIP *ptz, const QHostAddress &address);
+	void detach(PTZViscaOverIP *ptz);
+	uint64_t unknownSenderCount() { return unknown_sender_count; }
+	void writeStatistics(obs_data_t *data) const { channel->writeStatistics(data); }
 
 	static ViscaUDPSocket *get_interface(int port);
-
-public slots:
-	void poll();
 };
 
 class PTZViscaOverIP : public PTZVisca {
@@ -40,18 +68,39 @@ class PTZViscaOverIP : public PTZVisca {
 
 private:
 	uint32_t seq_state[8];
+
+	/* Loss and reorder handling */
+	static const int recent_size = 8;
+	static const int reorder_window = 4;
+	static const int max_sequence_resets = 2;
+	uint64_t recent_replies[recent_size] = {};
+	int recent_pos = 0;
+	QList<QByteArray> held_replies;
+	int resync_attempts = 0;
+	bool is_duplicate(uint32_t seq, uint8_t reply);
+	void remember_reply(uint32_t seq, uint8_t reply);
+	void process_datagram(const QByteArray &data);
+	void reset_sequence();
+	void resync();
 	QString host;
 	QHostAddress ip_address;
 	ViscaUDPSocket *iface;
+	int udp_port = 52381;
 	bool quirk_visca_udp_no_seq;
+	/* Optionally use a connected socket owned by this camera instead of
+	 * the socket shared by all cameras on the same port */
+	bool dedicated_socket = false;
+	ViscaUDPSocket *own_iface = nullptr;
 	void attach_interface(ViscaUDPSocket *iface);
+	void update_interface();
 
 protected:
 	void send_immediate(const QByteArray &msg);
+	bool flush_receive();
 	void reset();
 
 public slots:
-	void receive_datagram(const QNetworkDatagram &datagram);
+	void receive_datagram(const QByteArray &datagram);
 	void lookup_host_callback(const QHostInfo hostinfo);
 
 public:
@@ -61,5 +110,6 @@ public:
 
 	void set_config(OBSData ptz_data);
 	OBSData get_config();
+	OBSData get_settings();
 	obs_properties_t *get_obs_properties();
 };
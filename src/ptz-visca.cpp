@@ -514,8 +514,13 @@ PTZVisca::PTZVisca(OBSData config) : PTZDevice(config)
 {
 	for (int i = 0; i < 8; i++)
 		active_cmd[i] = std::nullopt;
-	connect(&timeout_timer, &QTimer::timeout, this, &PTZVisca::timeout);
-	connect(&update_timer, &QTimer::timeout, this, &PTZVisca::update_timer_callback);
+	timeout_timer.setCallback([this]() { timeout(); });
+	update_timer.setCallback([this]() { update_timer_callback(); });
+	snapshot_keys = {
+		"power_on",      "pan_pos",     "tilt_pos", "zoom_pos", "focus_pos",  "focus_af_enabled",  "focus_af_mode",
+		"wb_mode",       "r_gain",      "b_gain",   "iris_pos", "gain_pos",   "bright_pos",        "shutter_pos",
+		"exposure_mode", "exposure_comp_pos",
+	};
 }
 
 void PTZVisca::set_settings(OBSData new_settings)
@@ -639,8 +644,15 @@ void PTZVisca::send_packet(const QByteArray &packet)
 
 void PTZVisca::timeout()
 {
+	/* A reply may already be waiting in the transport queue if the UI
+	 * thread was stalled. Process it before deciding to retry */
+	if (flush_receive() && (timeout_timer.isActive() || !active_cmd[0].has_value()))
+		return;
+
 	if ((status & STATUS_CONNECTED) && active_cmd[0].has_value() && (timeout_retry < 3)) {
+		retransmitting = true;
 		send_packet(active_cmd[0].value().cmd);
+		retransmitting = false;
 		timeout_retry++;
 	} else {
 		status &= ~STATUS_CONNECTED;
@@ -663,6 +675,7 @@ void PTZVisca::update_timer_callback()
 void PTZVisca::cmd_get_camera_info()
 {
 	status |= STATUS_CONNECTED;
+	markUnverified();
 	for (auto key : inquires.keys())
 		stale_settings += key;
 	update_timer.start(1000);
@@ -705,6 +718,7 @@ void PTZVisca::receive(const QByteArray &msg)
 			/* Mark returned properties as clean */
 			for (auto item = obs_data_first(rslt_props); item; obs_data_item_next(&item))
 				stale_settings -= obs_data_item_get_name(item);
+			markVerified(rslt_props);
 
 			/* Data has been updated */
 			obs_data_set_obj(rslt_props, "statistics", statistics);
@@ -11,6 +11,7 @@
 #include <QTimer>
 #include "protocol-helpers.hpp"
 #include "ptz-device.hpp"
+#include "timer-wheel.hpp"
 
 #define VISCA_RESPONSE_ADDRESS 0x30
 #define VISCA_RESPONSE_ACK 0x40
@@ -33,12 +34,13 @@ public:
 
 protected:
 	unsigned int timeout_retry = 0;
+	bool retransmitting = false; /* Set while the active command is being resent */
 	unsigned int address;
 	bool protocol_trace = false;
 	QList<PTZCmd> pending_cmds;
 	std::optional<PTZCmd> active_cmd[8];
-	QTimer timeout_timer;
-	QTimer update_timer;
+	PTZTimer timeout_timer;
+	PTZTimer update_timer;
 
 	unsigned int visca_pan_speed_max = 0x18;
 	unsigned int visca_tilt_speed_max = 0x14;
@@ -47,6 +49,7 @@ protected:
 
 	bool send_pantilt();
 	virtual void send_immediate(const QByteArray &msg) = 0;
+	virtual bool flush_receive() { return false; }
 	void send_packet(const QByteArray &msg);
 	void send(PTZCmd cmd);
 	void send(PTZCmd cmd, QList<int> args);
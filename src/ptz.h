@@ -29,6 +29,7 @@ extern void ptz_load_settings(void);
 extern obs_data_array_t *ptz_devices_get_config(void);
 extern obs_source_t *ptz_device_find_source_using_ptz_name(uint32_t device_id);
 extern void ptz_devices_set_config(obs_data_array_t *devices);
+extern void ptz_devices_save_state(void);
 
 extern bool ptz_scene_is_source_active(obs_source_t *scene, obs_source_t *source);
 
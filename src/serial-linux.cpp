@@ -0,0 +1,246 @@
+/* Low latency native serial port backend (Linux)
+ *
+ * Copyright 2026 agent <agent@local>
+ *
+ * SPDX-License-Identifier: GPLv2
+ */
+
+#include <cstring>
+#include <errno.h>
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+#include <linux/serial.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <QFile>
+#include <QFileInfo>
+#include "ptz.h"
+#include "serial-linux.hpp"
+
+static speed_t baud_to_speed(int baud_rate)
+{
+	switch (baud_rate) {
+	case 1200:
+		return B1200;
+	case 2400:
+		return B2400;
+	case 4800:
+		return B4800;
+	case 9600:
+		return B9600;
+	case 19200:
+		return B19200;
+	case 38400:
+		return B38400;
+	case 57600:
+		return B57600;
+	case 115200:
+		return B115200;
+	default:
+		return B0;
+	}
+}
+
+/* FTDI style adapters buffer input for up to 16 ms by default. The latency
+ * timer is only writable with the right permissions; failure is harmless.
+ * The previous value is kept so that close() can put it back */
+void PTZLinuxSerial::lowerLatencyTimer(const QString &port_name)
+{
+	QString tty = QFileInfo(port_name).fileName();
+	QFile timer(QString("/sys/bus/usb-serial/devices/%1/latency_timer").arg(tty));
+	if (!timer.open(QIODevice::ReadWrite | QIODevice::Unbuffered))
+		return;
+	QByteArray prev = timer.readAll().trimmed();
+	if (timer.seek(0) && timer.write("1") > 0) {
+		latency_timer_path = timer.fileName();
+		latency_timer_saved = prev;
+	}
+}
+
+bool PTZLinuxSerial::open(const QString &port_name, int baud_rate)
+{
+	speed_t speed = baud_to_speed(baud_rate);
+	if (speed == B0)
+		return false;
+
+	QString path = port_name.startsWith('/') ? port_name : "/dev/" + port_name;
+	fd = ::open(QFile::encodeName(path).constData(), O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+	if (fd < 0)
+		return false;
+
+	struct termios tio;
+	if (tcgetattr(fd, &tio) < 0) {
+		close();
+		return false;
+	}
+	cfmakeraw(&tio);
+	tio.c_cflag |= CLOCAL | CREAD;
+	tio.c_cflag &= ~(CSTOPB | CRTSCTS);
+	cfsetispeed(&tio, speed);
+	cfsetospeed(&tio, speed);
+	if (tcsetattr(fd, TCSANOW, &tio) < 0) {
+		close();
+		return false;
+	}
+	tcflush(fd, TCIOFLUSH);
+
+	struct serial_struct ss;
+	if (ioctl(fd, TIOCGSERIAL, &ss) == 0 && !(ss.flags & ASYNC_LOW_LATENCY)) {
+		ss.flags |= ASYNC_LOW_LATENCY;
+		if (ioctl(fd, TIOCSSERIAL, &ss) == 0)
+			low_latency_set = true;
+	}
+	lowerLatencyTimer(path);
+
+	wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (wake_fd < 0 || epoll_fd < 0) {
+		close();
+		return false;
+	}
+	struct epoll_event ev = {};
+	ev.events = EPOLLIN;
+	ev.data.fd = fd;
+	epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+	ev.data.fd = wake_fd;
+	epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wake_fd, &ev);
+
+	stopping = false;
+	reader = std::thread(&PTZLinuxSerial::run, this);
+	return true;
+}
+
+void PTZLinuxSerial::wake()
+{
+	uint64_t one = 1;
+	if (::write(wake_fd, &one, sizeof(one)) < 0)
+		blog(LOG_DEBUG, "serial wake failed: %s", strerror(errno));
+}
+
+void PTZLinuxSerial::close()
+{
+	if (reader.joinable()) {
+		stopping = true;
+		wake();
+		reader.join();
+	}
+	if (epoll_fd >= 0)
+		::close(epoll_fd);
+	if (wake_fd >= 0)
+		::close(wake_fd);
+
+	/* Leave the adapter as it was found */
+	struct serial_struct ss;
+	if (fd >= 0 && low_latency_set && ioctl(fd, TIOCGSERIAL, &ss) == 0) {
+		ss.flags &= ~ASYNC_LOW_LATENCY;
+		ioctl(fd, TIOCSSERIAL, &ss);
+	}
+	low_latency_set = false;
+	if (!latency_timer_path.isEmpty()) {
+		QFile timer(latency_timer_path);
+		if (timer.open(QIODevice::WriteOnly))
+			timer.write(latency_timer_saved);
+		latency_timer_path.clear();
+	}
+
+	if (fd >= 0)
+		::close(fd);
+	epoll_fd = wake_fd = fd = -1;
+}
+
+/* Queue data for the reader thread to write */
+bool PTZLinuxSerial::write(const QByteArray &data)
+{
+	if (fd < 0)
+		return false;
+	{
+		std::lock_guard<std::mutex> guard(tx_lock);
+		bool idle = tx_buffer.isEmpty();
+		tx_buffer += data;
+		if (!idle)
+			return true; /* Already queued behind a full tty buffer */
+	}
+	wake();
+	return true;
+}
+
+/* Runs on the reader thread. Writes as much of the queue as the tty will take
+ * and waits for EPOLLOUT if anything is left over */
+void PTZLinuxSerial::flush()
+{
+	bool blocked = false;
+	{
+		std::lock_guard<std::mutex> guard(tx_lock);
+		qsizetype done = 0;
+		while (done < tx_buffer.size()) {
+			ssize_t n = ::write(fd, tx_buffer.constData() + done, tx_buffer.size() - done);
+			if (n < 0) {
+				if (errno == EINTR)
+					continue;
+				if (errno == EAGAIN) {
+					blocked = true;
+					break;
+				}
+				blog(LOG_DEBUG, "serial write failed: %s", strerror(errno));
+				done = tx_buffer.size();
+				break;
+			}
+			done += n;
+		}
+		tx_buffer.remove(0, done);
+	}
+	if (blocked == tx_blocked)
+		return;
+	tx_blocked = blocked;
+	struct epoll_event ev = {};
+	ev.events = blocked ? EPOLLIN | EPOLLOUT : EPOLLIN;
+	ev.data.fd = fd;
+	epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &ev);
+}
+
+void PTZLinuxSerial::drain()
+{
+	char buf[256];
+	QByteArray data;
+	ssize_t n;
+	while ((n = ::read(fd, buf, sizeof(buf))) > 0)
+		data.append(buf, n);
+	if (!data.isEmpty() && receive)
+		receive(std::move(data));
+}
+
+void PTZLinuxSerial::run()
+{
+	while (true) {
+		struct epoll_event events[2];
+		int n = epoll_wait(epoll_fd, events, 2, -1);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return;
+		}
+		for (int i = 0; i < n; i++) {
+			if (events[i].data.fd == wake_fd) {
+				uint64_t count;
+				if (::read(wake_fd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+					return;
+				if (stopping)
+					return;
+				flush();
+				continue;
+			}
+			if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+				blog(LOG_INFO, "serial port closed unexpectedly");
+				if (hangup)
+					hangup();
+				return;
+			}
+			if (events[i].events & EPOLLOUT)
+				flush();
+			if (events[i].events & EPOLLIN)
+				drain();
+		}
+	}
+}
@@ -0,0 +1,64 @@
+/* Low latency native serial port backend (Linux)
+ *
+ * Copyright 2026 agent <agent@local>
+ *
+ * SPDX-License-Identifier: GPLv2
+ */
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <QByteArray>
+#include <QString>
+
+/*
+ * PTZLinuxSerial - Raw tty access tuned for short request/response frames
+ *
+ * The port is put in raw mode with ASYNC_LOW_LATENCY set (and the USB-serial
+ * latency timer lowered where the driver exposes it); both are put back when
+ * the port is closed. A dedicated thread waits on the non-blocking tty with
+ * epoll and hands over whatever has arrived as soon as it is readable, so
+ * VMIN/VTIME play no part and splitting the stream into frames is left to the
+ * protocol.
+ *
+ * Writes are queued to the same thread, so callers never block on the tty.
+ * Whatever doesn't fit in the tty buffer is kept until epoll reports the port
+ * writable again.
+ */
+class PTZLinuxSerial {
+private:
+	int fd = -1;
+	int wake_fd = -1;
+	int epoll_fd = -1;
+	std::thread reader;
+	std::atomic<bool> stopping = false;
+
+	std::mutex tx_lock;
+	QByteArray tx_buffer;
+	bool tx_blocked = false; /* Only touched on the reader thread */
+
+	/* Adapter settings changed by open(), restored by close() */
+	bool low_latency_set = false;
+	QString latency_timer_path;
+	QByteArray latency_timer_saved;
+
+	void lowerLatencyTimer(const QString &port_name);
+	void run();
+	void drain();
+	void flush();
+	void wake();
+
+public:
+	/* Called on the reader thread with each chunk read from the port */
+	std::function<void(QByteArray &&)> receive;
+	/* Called on the reader thread if the device goes away (e.g. unplugged) */
+	std::function<void()> hangup;
+
+	~PTZLinuxSerial() { close(); }
+	bool open(const QString &port_name, int baud_rate);
+	void close();
+	bool isOpen() const { return fd >= 0; }
+	bool write(const QByteArray &data);
+};
@@ -29,6 +29,9 @@
 #include "ptz-controls.hpp"
 #include "settings.hpp"
 #include "ui_settings.h"
+#if defined(ENABLE_ONVIF)
+#include "onvif-discovery.hpp"
+#endif
 
 /* ----------------------------------------------------------------- */
 
@@ -221,6 +224,7 @@ void PTZSettings::on_addPTZ_clicked()
 #endif
 #if defined(ENABLE_ONVIF) // ONVIF disabled until code is reworked
 	QAction *addOnvif = addPTZContext.addAction("ONVIF (experimental)");
+	QAction *discoverOnvif = addPTZContext.addAction("ONVIF (discover on network)...");
 #endif
 	QAction *addUsbCam = addPTZContext.addAction("USB Camera (UVC)");
 	QAction *action = addPTZContext.exec(QCursor::pos());
@@ -270,6 +274,10 @@ void PTZSettings::on_addPTZ_clicked()
 		obs_data_set_string(cfg, "type", "onvif");
 		ptzDeviceList.make_device(cfg);
 	}
+	if (action == discoverOnvif) {
+		auto dialog = new PTZOnvifDiscoveryDialog(this);
+		dialog->show();
+	}
 #endif
 	if (action == addUsbCam) {
 		OBSData cfg = obs_data_create();
@@ -305,6 +313,7 @@ void PTZSettings::currentChanged(const QModelIndex &current, const QModelIndex &
 	ptz = ptzDeviceList.getDevice(current);
 	if (ptz) {
 		obs_data_apply(settings, ptz->get_settings());
+		obs_data_set_obj(settings, "plugin_statistics", ptzDeviceList.get_statistics());
 
 		auto rawjson = obs_data_get_json(settings);
 		/* Use QJsonDocument for nice formatting */
@@ -0,0 +1,231 @@
+/* Hierarchical timer wheel
+ *
+ * Copyright 2026 agent <agent@local>
+ *
+ * SPDX-License-Identifier: GPLv2
+ */
+
+#include <util/platform.h>
+#include "timer-wheel.hpp"
+
+void PTZTimerNode::unlink()
+{
+	prev->next = next;
+	next->prev = prev;
+	prev = next = this;
+}
+
+void PTZTimerNode::append(PTZTimerNode *node)
+{
+	node->prev = prev;
+	node->next = this;
+	prev->next = node;
+	prev = node;
+}
+
+void PTZTimer::start(int msec)
+{
+	auto wheel = PTZTimerWheel::instance();
+	if (isActive())
+		wheel->cancel(this);
+	interval_ms = msec;
+	deadline_ns = os_gettime_ns() + (uint64_t)std::max(msec, 0) * 1000000;
+	wheel->add(this);
+}
+
+void PTZTimer::stop()
+{
+	if (isActive())
+		PTZTimerWheel::instance()->cancel(this);
+}
+
+/* Milliseconds until the timer is due, or -1 if it isn't active */
+int PTZTimer::remainingTime() const
+{
+	if (!isActive())
+		return -1;
+	uint64_t now = os_gettime_ns();
+	return deadline_ns > now ? (int)((deadline_ns - now + 999999) / 1000000) : 0;
+}
+
+PTZTimerWheel *PTZTimerWheel::instance()
+{
+	static PTZTimerWheel *wheel = new PTZTimerWheel();
+	return wheel;
+}
+
+PTZTimerWheel::PTZTimerWheel() : QObject(), base_ns(os_gettime_ns())
+{
+	tick_timer.setTimerType(Qt::PreciseTimer);
+	tick_timer.setSingleShot(true);
+	connect(&tick_timer, &QTimer::timeout, this, &PTZTimerWheel::tick);
+}
+
+uint64_t PTZTimerWheel::now_tick()
+{
+	return (os_gettime_ns() - base_ns) / (tick_ms * 1000000ULL);
+}
+
+/* Earliest tick that needs processing. For the upper levels that is the tick
+ * where the first occupied slot gets cascaded down. */
+uint64_t PTZTimerWheel::next_tick()
+{
+	if (expired.linked())
+		return current_tick;
+	uint64_t next = UINT64_MAX;
+	for (int level = 0; level < wheel_levels; level++) {
+		int shift = wheel_bits * level;
+		uint64_t slot = current_tick >> shift;
+		for (int i = 1; i <= wheel_size; i++) {
+			if (wheel[level][(slot + i) & (wheel_size - 1)].linked()) {
+				next = std::min(next, (slot + i) << shift);
+				break;
+			}
+		}
+	}
+	return next;
+}
+
+/* Arm the Qt timer for the next tick with work to do, or stop it if the wheel
+ * is empty */
+void PTZTimerWheel::arm()
+{
+	if (!active_count) {
+		tick_timer.stop();
+		return;
+	}
+	armed_tick = next_tick();
+	uint64_t due_ns = base_ns + armed_tick * tick_ms * 1000000ULL;
+	uint64_t now = os_gettime_ns();
+	tick_timer.start(due_ns > now ? (int)((due_ns - now + 999999) / 1000000) : 0);
+}
+
+/* Walk the wheel up to the target tick, cascading the upper levels and moving
+ * everything that expires onto the expired list */
+void PTZTimerWheel::advance(uint64_t target)
+{
+	while (current_tick < target) {
+		current_tick++;
+		int index = current_tick & (wheel_size - 1);
+		if (index == 0) {
+			int index1 = (current_tick >> wheel_bits) & (wheel_size - 1);
+			if (index1 == 0)
+				cascade(2, (current_tick >> (wheel_bits * 2)) & (wheel_size - 1));
+			cascade(1, index1);
+		}
+		PTZTimerNode *head = &wheel[0][index];
+		while (head->linked()) {
+			auto node = head->next;
+			node->unlink();
+			expired.append(node);
+		}
+	}
+}
+
+/* Place a timer in the correct wheel slot based on the distance between its
+ * expiry tick and the current tick. Timers in the upper levels are cascaded
+ * down as the lower level wheel wraps around. */
+void PTZTimerWheel::insert(PTZTimer *timer)
+{
+	uint64_t delta = timer->expires - current_tick;
+	if (timer->expires <= current_tick) {
+		expired.append(timer);
+		return;
+	}
+	for (int level = 0; level < wheel_levels; level++) {
+		uint64_t span = 1ULL << (wheel_bits * (level + 1));
+		if (delta < span || level == wheel_levels - 1) {
+			if (delta >= span)
+				timer->expires = current_tick + span - 1;
+			int index = (timer->expires >> (wheel_bits * level)) & (wheel_size - 1);
+			wheel[level][index].append(timer);
+			return;
+		}
+	}
+}
+
+void PTZTimerWheel::add(PTZTimer *timer)
+{
+	/* The wheel is only advanced when the Qt timer fires; catch up before
+	 * inserting. Nothing is pending while idle, so just jump ahead. */
+	if (!active_count)
+		current_tick = now_tick();
+	else if (!firing)
+		advance(now_tick());
+	uint64_t ticks = (timer->deadline_ns - base_ns + tick_ms * 1000000ULL - 1) / (tick_ms * 1000000ULL);
+	timer->expires = std::max(ticks, current_tick + 1);
+	insert(timer);
+	active_count++;
+	if (!firing && (!tick_timer.isActive() || timer->expires < armed_tick))
+		arm();
+}
+
+/* Waking up early for a cancelled timer is harmless, so the Qt timer is only
+ * stopped once the wheel is empty */
+void PTZTimerWheel::cancel(PTZTimer *timer)
+{
+	timer->unlink();
+	if (--active_count == 0)
+		tick_timer.stop();
+}
+
+void PTZTimerWheel::cascade(int level, int index)
+{
+	PTZTimerNode list;
+	PTZTimerNode *head = &wheel[level][index];
+	while (head->linked()) {
+		auto node = head->next;
+		node->unlink();
+		list.append(node);
+	}
+	while (list.linked()) {
+		auto timer = static_cast<PTZTimer *>(list.next);
+		timer->unlink();
+		insert(timer);
+	}
+}
+
+void PTZTimerWheel::tick()
+{
+	advance(now_tick());
+
+	/* Fire everything that expired in one batch. Callbacks are free to
+	 * start or stop any timer, including ones still in the expired list.
+	 * Lateness is measured from the tick the timer was due on, so the
+	 * rounding up to a tick boundary isn't counted. */
+	uint64_t now = os_gettime_ns();
+	firing = true;
+	while (expired.linked()) {
+		auto timer = static_cast<PTZTimer *>(expired.next);
+		timer->unlink();
+		active_count--;
+
+		uint64_t due_ns = std::max<uint64_t>(timer->deadline_ns, base_ns + timer->expires * tick_ms * 1000000ULL);
+		uint64_t late = now > due_ns ? now - due_ns : 0;
+		fired_count++;
+		lateness_total_ns += late;
+		lateness_max_ns = std::max(lateness_max_ns, late);
+		if (late > tick_ms * 1000000ULL)
+			late_count++;
+
+		if (!timer->single_shot) {
+			timer->deadline_ns = now + (uint64_t)timer->interval_ms * 1000000;
+			add(timer);
+		}
+		if (timer->callback)
+			timer->callback();
+	}
+	firing = false;
+
+	arm();
+}
+
+void PTZTimerWheel::writeStatistics(obs_data_t *data)
+{
+	obs_data_set_int(data, "timer_wheel_active", active_count);
+	obs_data_set_int(data, "timer_wheel_fired_count", fired_count);
+	obs_data_set_int(data, "timer_wheel_late_count", late_count);
+	obs_data_set_double(data, "timer_wheel_lateness_avg_ms",
+			    fired_count ? lateness_total_ns / 1000000.0 / fired_count : 0.0);
+	obs_data_set_double(data, "timer_wheel_lateness_max_ms", lateness_max_ns / 1000000.0);
+}
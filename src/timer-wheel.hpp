@@ -0,0 +1,102 @@
+/* Hierarchical timer wheel
+ *
+ * Copyright 2026 agent <agent@local>
+ *
+ * SPDX-License-Identifier: GPLv2
+ */
+#pragma once
+
+#include <functional>
+#include <QObject>
+#include <QTimer>
+#include <obs.hpp>
+
+/*
+ * Protocol drivers re-arm their timers many times per second. Instead of each
+ * device owning several QTimers, all deadlines are kept in a single
+ * hierarchical timer wheel driven by one Qt timer. Insert and cancel are O(1),
+ * and all timers that expire on the same tick are fired as a batch. The Qt
+ * timer is a single shot armed for the earliest pending tick, so the UI thread
+ * only wakes when something is due.
+ *
+ * The wheel is not thread safe. Timers must only be used from the thread
+ * running the Qt main loop.
+ */
+struct PTZTimerNode {
+	PTZTimerNode *prev = this;
+	PTZTimerNode *next = this;
+	bool linked() const { return next != this; }
+	void unlink();
+	void append(PTZTimerNode *node);
+};
+
+class PTZTimer : private PTZTimerNode {
+	friend class PTZTimerWheel;
+
+private:
+	std::function<void()> callback;
+	uint64_t deadline_ns = 0;
+	uint64_t expires = 0;
+	int interval_ms = 0;
+	bool single_shot = false;
+
+public:
+	PTZTimer() {}
+	PTZTimer(std::function<void()> func) : callback(func) {}
+	~PTZTimer() { stop(); }
+	PTZTimer(const PTZTimer &) = delete;
+	PTZTimer &operator=(const PTZTimer &) = delete;
+
+	void setCallback(std::function<void()> func) { callback = func; }
+	void setSingleShot(bool enable) { single_shot = enable; }
+	bool isSingleShot() const { return single_shot; }
+	int interval() const { return interval_ms; }
+	int remainingTime() const;
+	bool isActive() const { return linked(); }
+	void start(int msec);
+	void start() { start(interval_ms); }
+	void stop();
+};
+
+class PTZTimerWheel : public QObject {
+	Q_OBJECT
+	friend class PTZTimer;
+
+private:
+	static const int tick_ms = 5;
+	static const int wheel_bits = 8;
+	static const int wheel_size = 1 << wheel_bits;
+	static const int wheel_levels = 3;
+
+	PTZTimerNode wheel[wheel_levels][wheel_size];
+	PTZTimerNode expired;
+	QTimer tick_timer;
+	uint64_t base_ns;
+	uint64_t current_tick = 0;
+	uint64_t armed_tick = 0;
+	int active_count = 0;
+	bool firing = false;
+
+	/* Statistics */
+	uint64_t fired_count = 0;
+	uint64_t late_count = 0;
+	uint64_t lateness_total_ns = 0;
+	uint64_t lateness_max_ns = 0;
+
+	uint64_t now_tick();
+	uint64_t next_tick();
+	void arm();
+	void advance(uint64_t target);
+	void insert(PTZTimer *timer);
+	void add(PTZTimer *timer);
+	void cancel(PTZTimer *timer);
+	void cascade(int level, int index);
+
+private slots:
+	void tick();
+
+public:
+	PTZTimerWheel();
+	static PTZTimerWheel *instance();
+	void writeStatistics(obs_data_t *data);
+};
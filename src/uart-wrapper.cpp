@@ -5,45 +5,278 @@
  * SPDX-License-Identifier: GPLv2
  */
 
+#include <algorithm>
 #include <QSerialPortInfo>
 #include <QSerialPort>
 #include <QMetaEnum>
+#include <QFile>
+#include <QPointer>
+#include <QCoreApplication>
 #include "uart-wrapper.hpp"
 #include "ptz-device.hpp"
+#include "worker-pool.hpp"
 
-PTZUARTWrapper::PTZUARTWrapper(QString &port_name) : port_name(port_name)
+PTZUARTWrapper::PTZUARTWrapper(QString &port_name) : port_name(port_name), io_port(new PTZUARTPort())
 {
-	connect(&uart, &QSerialPort::readyRead, this, &PTZUARTWrapper::poll);
-	uart.setPortName(port_name);
+	channel = PTZIOChannel::create(this, io_port);
+	channel->transmit = [io = io_port](PTZIOFrame &frame) {
+		if (io->port && io->port->isOpen())
+			io->port->write(frame.data);
+	};
+	channel->receive = [this](PTZIOFrame &frame) {
+		uint64_t latency = os_gettime_ns() - frame.timestamp_ns;
+		rx_latency_count++;
+		rx_latency_total_ns += latency;
+		rx_latency_max_ns = std::max(rx_latency_max_ns, latency);
+		receiveBytes(frame.data);
+	};
+	io_port->moveToThread(ptz_io_thread());
+
+	reopen_timer.setSingleShot(true);
+	reopen_timer.setCallback([this]() { open(); });
+#if defined(__linux__)
+	/* Device nodes appear in /dev when an adapter is plugged in. Retry
+	 * straight away instead of waiting out the backoff */
+	dev_watcher = new QFileSystemWatcher({"/dev"}, this);
+	connect(dev_watcher, &QFileSystemWatcher::directoryChanged, this, [this]() {
+		if (is_open || opening)
+			return;
+		QString path = port_name.startsWith('/') ? port_name : "/dev/" + port_name;
+		if (QFile::exists(path))
+			open();
+	});
+#endif
 }
 
-bool PTZUARTWrapper::open()
+PTZUARTWrapper::~PTZUARTWrapper()
 {
-	bool rc = uart.open(QIODevice::ReadWrite);
-	if (!rc)
-		blog(LOG_INFO, "VISCA Unable to open UART %s", qPrintable(port_name));
-	return rc;
+#if defined(__linux__)
+	native.reset();
+#endif
+	ptz_io_release(io_port);
 }
 
-void PTZUARTWrapper::close()
+/*
+ * Opening a missing or wedged adapter can block for a long time, so it never
+ * happens on the UI thread. The native backend is tried on a worker thread,
+ * falling back to a QSerialPort opened on the I/O thread. The result is handed
+ * back to the UI thread.
+ *
+ * The wrapper may be deleted while an open is in flight, so the background
+ * steps only hold a QPointer to it, checked back on the UI thread. Each
+ * attempt opens its own port handle; a result that arrives after close() is
+ * discarded without touching the port of a later attempt.
+ *
+ * Only one attempt runs at a time. A stale attempt may still be opening the
+ * tty, and its reader would feed the same single producer channel, so an
+ * open() requested meanwhile is started once the stale result has been
+ * discarded.
+ */
+void PTZUARTWrapper::open()
 {
-	if (uart.isOpen())
-		uart.close();
+	if (is_open || opening)
+		return;
+	if (attempt_running) {
+		open_after_attempt = true;
+		return;
+	}
+	attempt_running = true;
+	opening = true;
+	reopen_timer.stop();
+	open_start_ns = os_gettime_ns();
+
+	int generation = open_generation;
+	QPointer<PTZUARTWrapper> self(this);
+#if defined(__linux__)
+	PTZWorkerPool::instance()->submit([self, generation, name = port_name, baud = baud_rate, ch = channel]() {
+		auto port = new PTZLinuxSerial();
+		port->receive = [ch](QByteArray &&data) {
+			PTZIOFrame frame;
+			frame.data = std::move(data);
+			ch->post(std::move(frame));
+		};
+		port->hangup = [self, generation]() {
+			QMetaObject::invokeMethod(
+				qApp,
+				[self, generation]() {
+					if (self)
+						self->portLost(generation);
+				},
+				Qt::QueuedConnection);
+		};
+		bool ok = port->open(name, baud);
+		if (!ok) {
+			delete port;
+			port = nullptr;
+		}
+		QMetaObject::invokeMethod(
+			qApp,
+			[self, generation, port]() {
+				if (!self) {
+					delete port;
+					return;
+				}
+				if (generation != self->open_generation) {
+					delete port;
+					self->attemptFinished();
+					return;
+				}
+				if (!port) {
+					self->openFallback(generation);
+					return;
+				}
+				self->native.reset(port);
+				blog(LOG_INFO, "UART %s opened with low latency backend", qPrintable(self->port_name));
+				self->openComplete(generation, nullptr);
+			},
+			Qt::QueuedConnection);
+	});
+#else
+	openFallback(generation);
+#endif
 }
 
-void PTZUARTWrapper::setBaudRate(int baudRate)
+void PTZUARTWrapper::openFallback(int generation)
 {
-	if (!baudRate || baudRate == uart.baudRate())
+	QPointer<PTZUARTWrapper> self(this);
+	ptz_io_invoke(io_port, [self, io = io_port, generation, name = port_name, baud = baud_rate]() {
+		auto port = new QSerialPort(name, io);
+		port->setBaudRate(baud);
+		if (!port->open(QIODevice::ReadWrite)) {
+			delete port;
+			port = nullptr;
+		}
+		QMetaObject::invokeMethod(
+			qApp,
+			[self, generation, port]() {
+				/* A deleted wrapper takes its ports with it */
+				if (self)
+					self->openComplete(generation, port);
+			},
+			Qt::QueuedConnection);
+	});
+}
+
+/* Called with the QSerialPort opened by the fallback path, or null. The native
+ * backend has already been installed when it succeeded. */
+void PTZUARTWrapper::openComplete(int generation, QSerialPort *port)
+{
+#if defined(__linux__)
+	bool ok = port || native;
+#else
+	bool ok = port;
+#endif
+	if (generation != open_generation) {
+		/* close() was called while the open was in flight */
+		if (port)
+			ptz_io_invoke(io_port, [port]() { delete port; }, true);
+		attemptFinished();
+		return;
+	}
+	attempt_running = false;
+	open_after_attempt = false;
+	opening = false;
+	if (!ok) {
+		blog(LOG_INFO, "Unable to open UART %s, retrying in %i ms", qPrintable(port_name),
+		     reopen_delay_ms);
+		scheduleReopen();
 		return;
+	}
+	if (port) {
+		QPointer<PTZUARTWrapper> self(this);
+		ptz_io_invoke(io_port, [self, io = io_port, port, ch = channel, generation]() {
+			io->port = port;
+			QObject::connect(port, &QSerialPort::readyRead, port, [port, ch]() {
+				PTZIOFrame frame;
+				frame.data = port->readAll();
+				ch->post(std::move(frame));
+			});
+			QObject::connect(port, &QSerialPort::errorOccurred, port,
+					 [self, generation](QSerialPort::SerialPortError error) {
+						 if (error != QSerialPort::ResourceError)
+							 return;
+						 QMetaObject::invokeMethod(
+							 qApp,
+							 [self, generation]() {
+								 if (self)
+									 self->portLost(generation);
+							 },
+							 Qt::QueuedConnection);
+					 });
+		});
+	}
+	is_open = true;
+	reopen_delay_ms = reopen_min_ms;
+	blog(LOG_INFO, "UART %s open after %.1f ms", qPrintable(port_name),
+	     (os_gettime_ns() - open_start_ns) / 1000000.0);
+	opened();
+}
 
+/* A discarded attempt has released its port; start the open that was
+ * requested while it was running */
+void PTZUARTWrapper::attemptFinished()
+{
+	attempt_running = false;
+	if (open_after_attempt) {
+		open_after_attempt = false;
+		open();
+	}
+}
+
+void PTZUARTWrapper::scheduleReopen()
+{
+	reopen_timer.start(reopen_delay_ms);
+	reopen_delay_ms = std::min(reopen_delay_ms * 2, reopen_max_ms);
+}
+
+/* The adapter went away underneath us; tear down and wait for it to return */
+void PTZUARTWrapper::portLost(int generation)
+{
+	if (generation != open_generation || !is_open)
+		return;
+	blog(LOG_INFO, "UART %s lost, waiting for it to reappear", qPrintable(port_name));
 	close();
-	uart.setBaudRate(baudRate);
+	reopen_count++;
+	scheduleReopen();
+}
+
+void PTZUARTWrapper::close()
+{
+	open_generation++;
+	opening = false;
+	open_after_attempt = false;
+	reopen_timer.stop();
+#if defined(__linux__)
+	native.reset();
+#endif
+	ptz_io_invoke(
+		io_port,
+		[io = io_port]() {
+			delete io->port;
+			io->port = nullptr;
+		},
+		true);
+	bool was_open = is_open;
+	is_open = false;
+	if (was_open)
+		closed();
+}
+
+/* Ports are opened by setConfig() once the configured rate is known, so a new
+ * port isn't opened at the default rate only to be reopened straight away */
+void PTZUARTWrapper::setBaudRate(int baudRate)
+{
+	if (baudRate && baudRate != baud_rate) {
+		if (is_open || opening)
+			close();
+		baud_rate = baudRate;
+	}
 	open();
 }
 
 int PTZUARTWrapper::baudRate()
 {
-	return uart.baudRate();
+	return baud_rate;
 }
 
 void PTZUARTWrapper::setConfig(OBSData config)
@@ -84,12 +317,34 @@ void PTZUARTWrapper::addOBSProperties(obs_properties_t *props)
 
 void PTZUARTWrapper::send(const QByteArray &packet)
 {
-	if (!uart.isOpen())
+	if (!is_open)
+		return;
+#if defined(__linux__)
+	if (native) {
+		/* The native backend has its own writer thread; hold the write
+		 * back while a group command burst is open */
+		PTZIOBurst::defer([port = native.get(), packet]() { port->write(packet); });
 		return;
-	uart.write(packet);
+	}
+#endif
+	PTZIOFrame frame;
+	frame.data = packet;
+	channel->send(std::move(frame));
 }
 
-void PTZUARTWrapper::poll()
+void PTZUARTWrapper::writeStatistics(obs_data_t *data)
 {
-	receiveBytes(uart.readAll());
-};
+	obs_data_set_bool(data, "uart_low_latency",
+#if defined(__linux__)
+			  native != nullptr
+#else
+			  false
+#endif
+	);
+	obs_data_set_bool(data, "uart_open", is_open);
+	channel->writeStatistics(data);
+	obs_data_set_int(data, "uart_reopen_count", reopen_count);
+	obs_data_set_double(data, "uart_rx_latency_avg_ms",
+			    rx_latency_count ? rx_latency_total_ns / 1000000.0 / rx_latency_count : 0.0);
+	obs_data_set_double(data, "uart_rx_latency_max_ms", rx_latency_max_ns / 1000000.0);
+}
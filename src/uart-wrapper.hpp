@@ -6,9 +6,26 @@
  */
 #pragma once
 
+#include <atomic>
+#include <memory>
 #include <QObject>
+#include <QFileSystemWatcher>
 #include <obs.hpp>
 #include <QSerialPort>
+#include "io-thread.hpp"
+#include "timer-wheel.hpp"
+#if defined(__linux__)
+#include "serial-linux.hpp"
+#endif
+
+/*
+ * I/O thread side of a UART wrapper. Each open attempt creates its own
+ * QSerialPort as a child; only the one the UI thread accepted is current.
+ */
+class PTZUARTPort : public QObject {
+public:
+	QSerialPort *port = nullptr;
+};
 
 /*
  * Protocol UART wrapper abstract base class
@@ -18,8 +35,45 @@ class PTZUARTWrapper : public QObject {
 
 protected:
 	QString port_name;
-	QSerialPort uart;
+	PTZUARTPort *io_port; /* Lives on the I/O thread */
+	std::shared_ptr<PTZIOChannel> channel;
+	int baud_rate = QSerialPort::Baud9600;
+	bool is_open = false;
 	QByteArray rxbuffer;
+#if defined(__linux__)
+	/* Native low latency backend; QSerialPort is the fallback */
+	std::unique_ptr<PTZLinuxSerial> native;
+	QFileSystemWatcher *dev_watcher = nullptr;
+#endif
+
+	/* Opening is asynchronous and retried with exponential backoff. The
+	 * generation is bumped on close() so stale open results are discarded */
+	static const int reopen_min_ms = 250;
+	static const int reopen_max_ms = 10000;
+	int reopen_delay_ms = reopen_min_ms;
+	PTZTimer reopen_timer;
+	bool opening = false;
+	/* An open attempt, possibly a stale one, hasn't reported back yet */
+	bool attempt_running = false;
+	bool open_after_attempt = false;
+	std::atomic<int> open_generation = 0;
+	uint64_t open_start_ns = 0;
+	uint64_t reopen_count = 0;
+
+	void openFallback(int generation);
+	void openComplete(int generation, QSerialPort *port);
+	void portLost(int generation);
+	void attemptFinished();
+	void scheduleReopen();
+
+	/* Called on the UI thread each time the port comes up or is closed */
+	virtual void opened() {}
+	virtual void closed() {}
+
+	/* Time from bytes being read off the port to being handled */
+	uint64_t rx_latency_count = 0;
+	uint64_t rx_latency_total_ns = 0;
+	uint64_t rx_latency_max_ns = 0;
 
 signals:
 	void receive(const QByteArray &packet);
@@ -27,7 +81,8 @@ signals:
 
 public:
 	PTZUARTWrapper(QString &port_name);
-	virtual bool open();
+	~PTZUARTWrapper();
+	void open();
 	void close();
 	void setBaudRate(int baudRate);
 	int baudRate();
@@ -36,8 +91,7 @@ public:
 	virtual void addOBSProperties(obs_properties_t *props);
 	virtual void send(const QByteArray &packet);
 	virtual void receiveBytes(const QByteArray &bytes) = 0;
+	bool flush_receive() { return channel->drain(); }
+	virtual void writeStatistics(obs_data_t *data);
 	QString portName() { return port_name; }
-
-public slots:
-	void poll();
 };
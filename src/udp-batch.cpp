@@ -0,0 +1,212 @@
+/* Batched native UDP socket (Linux)
+ *
+ * Copyright 2026 agent <agent@local>
+ *
+ * SPDX-License-Identifier: GPLv2
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <errno.h>
+#include <unistd.h>
+#include "ptz.h"
+#include "udp-batch.hpp"
+
+PTZUDPBatchSocket::PTZUDPBatchSocket() : QObject()
+{
+	for (int i = 0; i < batch_size; i++)
+		rx_pool[i] = QByteArray(buffer_size, Qt::Uninitialized);
+}
+
+PTZUDPBatchSocket::~PTZUDPBatchSocket()
+{
+	delete notifier;
+	delete write_notifier;
+	if (fd >= 0)
+		::close(fd);
+}
+
+bool PTZUDPBatchSocket::open()
+{
+	fd = socket(AF_INET6, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+		return false;
+
+	int off = 0, on = 1;
+	setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &off, sizeof(off));
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+	return true;
+}
+
+void PTZUDPBatchSocket::watch()
+{
+	notifier = new QSocketNotifier(fd, QSocketNotifier::Read, this);
+	connect(notifier, &QSocketNotifier::activated, this, &PTZUDPBatchSocket::readable);
+	write_notifier = new QSocketNotifier(fd, QSocketNotifier::Write, this);
+	write_notifier->setEnabled(false);
+	connect(write_notifier, &QSocketNotifier::activated, this, &PTZUDPBatchSocket::writable);
+}
+
+static socklen_t to_sockaddr(const QHostAddress &addr, quint16 port, struct sockaddr_in6 *sa);
+
+bool PTZUDPBatchSocket::bind(quint16 port)
+{
+	if (!open())
+		return false;
+
+	struct sockaddr_in6 addr = {};
+	addr.sin6_family = AF_INET6;
+	addr.sin6_addr = in6addr_any;
+	addr.sin6_port = htons(port);
+	if (::bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		::close(fd);
+		fd = -1;
+		return false;
+	}
+
+	watch();
+	return true;
+}
+
+bool PTZUDPBatchSocket::connectTo(const QHostAddress &peer, quint16 port)
+{
+	if (!open())
+		return false;
+
+	struct sockaddr_in6 addr;
+	socklen_t len = to_sockaddr(peer, port, &addr);
+	if (::connect(fd, (struct sockaddr *)&addr, len) < 0) {
+		::close(fd);
+		fd = -1;
+		return false;
+	}
+	connected = true;
+
+	watch();
+	return true;
+}
+
+static QHostAddress from_sockaddr(const struct sockaddr_in6 *sa)
+{
+	QHostAddress addr((const struct sockaddr *)sa);
+	bool ok = false;
+	quint32 v4 = addr.toIPv4Address(&ok);
+	return ok ? QHostAddress(v4) : addr;
+}
+
+static socklen_t to_sockaddr(const QHostAddress &addr, quint16 port, struct sockaddr_in6 *sa)
+{
+	memset(sa, 0, sizeof(*sa));
+	sa->sin6_family = AF_INET6;
+	sa->sin6_port = htons(port);
+	if (addr.protocol() == QAbstractSocket::IPv4Protocol) {
+		/* v4-mapped address, ::ffff:a.b.c.d */
+		quint32 v4 = htonl(addr.toIPv4Address());
+		sa->sin6_addr.s6_addr[10] = 0xff;
+		sa->sin6_addr.s6_addr[11] = 0xff;
+		memcpy(&sa->sin6_addr.s6_addr[12], &v4, 4);
+	} else {
+		Q_IPV6ADDR v6 = addr.toIPv6Address();
+		memcpy(&sa->sin6_addr, &v6, 16);
+		sa->sin6_scope_id = addr.scopeId().toUInt();
+	}
+	return sizeof(*sa);
+}
+
+void PTZUDPBatchSocket::readable()
+{
+	int count;
+	do {
+		for (int i = 0; i < batch_size; i++) {
+			/* Still held by the receiver; give the slot a fresh buffer */
+			if (!rx_pool[i].isDetached())
+				rx_pool[i] = QByteArray(buffer_size, Qt::Uninitialized);
+			rx_pool[i].resize(buffer_size);
+			rx_iov[i].iov_base = rx_pool[i].data();
+			rx_iov[i].iov_len = buffer_size;
+			memset(&rx_msgs[i].msg_hdr, 0, sizeof(rx_msgs[i].msg_hdr));
+			rx_msgs[i].msg_hdr.msg_iov = &rx_iov[i];
+			rx_msgs[i].msg_hdr.msg_iovlen = 1;
+			rx_msgs[i].msg_hdr.msg_name = &rx_addrs[i];
+			rx_msgs[i].msg_hdr.msg_namelen = sizeof(rx_addrs[i]);
+		}
+		count = recvmmsg(fd, rx_msgs, batch_size, MSG_DONTWAIT, nullptr);
+		for (int i = 0; i < count; i++) {
+			PTZIOFrame frame;
+			/* Shrinking keeps the allocation, so the slot can grow back
+			 * in place once it is free again */
+			rx_pool[i].resize(rx_msgs[i].msg_len);
+			frame.data = rx_pool[i];
+			frame.address = from_sockaddr(&rx_addrs[i]);
+			frame.port = ntohs(rx_addrs[i].sin6_port);
+			if (receive)
+				receive(std::move(frame));
+		}
+	} while (count == batch_size);
+}
+
+/* Send as many frames as the socket will take; returns the number sent */
+size_t PTZUDPBatchSocket::transmit(std::vector<PTZIOFrame> &frames, quint16 port)
+{
+	size_t done = 0;
+	while (done < frames.size()) {
+		struct mmsghdr msgs[batch_size];
+		struct iovec iov[batch_size];
+		struct sockaddr_in6 addrs[batch_size];
+		int n = (int)std::min(frames.size() - done, (size_t)batch_size);
+		for (int i = 0; i < n; i++) {
+			auto &frame = frames[done + i];
+			/* sendmmsg() only reads the buffer; data() would detach a shared frame */
+			iov[i].iov_base = const_cast<char *>(frame.data.constData());
+			iov[i].iov_len = frame.data.size();
+			memset(&msgs[i], 0, sizeof(msgs[i]));
+			msgs[i].msg_hdr.msg_iov = &iov[i];
+			msgs[i].msg_hdr.msg_iovlen = 1;
+			if (!connected) {
+				msgs[i].msg_hdr.msg_name = &addrs[i];
+				msgs[i].msg_hdr.msg_namelen = to_sockaddr(frame.address, port, &addrs[i]);
+			}
+		}
+		int sent = sendmmsg(fd, msgs, n, MSG_DONTWAIT);
+		if (sent < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS)
+				return done;
+			/* Only the first frame failed (e.g. an unreachable peer);
+			 * skip it and carry on with the rest */
+			blog(LOG_DEBUG, "VISCA-over-IP sendmmsg failed: %s", strerror(errno));
+			sent = 1;
+		}
+		done += sent;
+	}
+	return done;
+}
+
+void PTZUDPBatchSocket::send(std::vector<PTZIOFrame> &frames, quint16 port)
+{
+	if (fd < 0)
+		return;
+	tx_port = port;
+	size_t done = tx_backlog.empty() ? transmit(frames, port) : 0;
+	if (done == frames.size())
+		return;
+
+	/* Keep the rest, in order, until the socket is writable again */
+	for (size_t i = done; i < frames.size(); i++) {
+		if (tx_backlog.size() >= tx_backlog_limit) {
+			blog(LOG_DEBUG, "VISCA-over-IP transmit backlog full, dropping %zu frames", frames.size() - i);
+			break;
+		}
+		tx_backlog.push_back(std::move(frames[i]));
+	}
+	write_notifier->setEnabled(true);
+}
+
+void PTZUDPBatchSocket::writable()
+{
+	write_notifier->setEnabled(false);
+	std::vector<PTZIOFrame> frames;
+	frames.swap(tx_backlog);
+	send(frames, tx_port);
+}
@@ -0,0 +1,68 @@
+/* Batched native UDP socket (Linux)
+ *
+ * Copyright 2026 agent <agent@local>
+ *
+ * SPDX-License-Identifier: GPLv2
+ */
+#pragma once
+
+#include <functional>
+#include <vector>
+#include <QObject>
+#include <QSocketNotifier>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include "io-thread.hpp"
+
+/*
+ * PTZUDPBatchSocket - Native dual-stack UDP socket using recvmmsg/sendmmsg
+ *
+ * The socket is drained in batches straight into a pool of receive buffers.
+ * Each datagram is handed on as a shallow copy of its pool buffer, which is
+ * reused for a later datagram once the receiver has let go of it, so steady
+ * state receive doesn't allocate or copy. All frames queued for transmit in
+ * one I/O thread wakeup are written with a single sendmmsg() call; anything
+ * the socket won't take is held until it is writable again. Must live on the
+ * I/O thread once bound. IPv4 peers are reported as plain IPv4 addresses, not
+ * as v4-mapped IPv6 addresses.
+ */
+class PTZUDPBatchSocket : public QObject {
+	Q_OBJECT
+
+private:
+	static const int batch_size = 32;
+	static const int buffer_size = 1500;
+	static const size_t tx_backlog_limit = 256;
+
+	int fd = -1;
+	bool connected = false;
+	QSocketNotifier *notifier = nullptr;
+	QSocketNotifier *write_notifier = nullptr;
+
+	/* Receive buffer pool */
+	QByteArray rx_pool[batch_size];
+	struct iovec rx_iov[batch_size];
+	struct sockaddr_in6 rx_addrs[batch_size];
+	struct mmsghdr rx_msgs[batch_size];
+
+	/* Frames waiting for the socket to become writable */
+	std::vector<PTZIOFrame> tx_backlog;
+	quint16 tx_port = 0;
+
+	bool open();
+	void watch();
+	void readable();
+	void writable();
+	size_t transmit(std::vector<PTZIOFrame> &frames, quint16 port);
+
+public:
+	std::function<void(PTZIOFrame &&)> receive; /* Called on the I/O thread */
+
+	PTZUDPBatchSocket();
+	~PTZUDPBatchSocket();
+	bool bind(quint16 port);
+	/* Connected mode: bound to an ephemeral local port, and the kernel
+	 * only delivers datagrams from `peer` */
+	bool connectTo(const QHostAddress &peer, quint16 port);
+	void send(std::vector<PTZIOFrame> &frames, quint16 port);
+};
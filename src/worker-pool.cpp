@@ -0,0 +1,237 @@
+/* Work-stealing worker pool and per-device strands
+ *
+ * Copyright 2026 agent <agent@local>
+ *
+ * SPDX-License-Identifier: GPLv2
+ */
+
+#include <algorithm>
+#include <util/threading.h>
+#include "ptz.h"
+#include "worker-pool.hpp"
+
+static std::mutex pool_lock;
+static PTZWorkerPool *pool = nullptr;
+static thread_local int current_worker = -1;
+static thread_local PTZStrand *current_strand = nullptr;
+
+PTZWorkerPool::PTZWorkerPool()
+{
+	size_t count = std::clamp(std::thread::hardware_concurrency(), 2U, 8U);
+	for (size_t i = 0; i < count; i++)
+		workers.emplace_back(std::make_unique<Worker>());
+	for (size_t i = 0; i < count; i++)
+		workers[i]->thread = std::thread(&PTZWorkerPool::run, this, i);
+	blog(LOG_INFO, "PTZ worker pool started with %zu threads", count);
+}
+
+PTZWorkerPool::~PTZWorkerPool()
+{
+	{
+		std::lock_guard<std::mutex> guard(idle_lock);
+		stopping = true;
+	}
+	idle_cond.notify_all();
+	for (auto &w : workers)
+		w->thread.join();
+}
+
+PTZWorkerPool *PTZWorkerPool::instance()
+{
+	std::lock_guard<std::mutex> guard(pool_lock);
+	if (!pool)
+		pool = new PTZWorkerPool();
+	return pool;
+}
+
+void PTZWorkerPool::shutdown()
+{
+	std::lock_guard<std::mutex> guard(pool_lock);
+	delete pool;
+	pool = nullptr;
+}
+
+void PTZWorkerPool::submit(Task task)
+{
+	/* Work submitted from a worker stays local to that worker; everything
+	 * else is spread round-robin */
+	size_t index = current_worker >= 0 ? (size_t)current_worker : next_worker++ % workers.size();
+	{
+		std::lock_guard<std::mutex> guard(workers[index]->lock);
+		if (current_worker >= 0)
+			workers[index]->tasks.push_front(std::move(task));
+		else
+			workers[index]->tasks.push_back(std::move(task));
+	}
+	{
+		std::lock_guard<std::mutex> guard(idle_lock);
+		pending++;
+	}
+	idle_cond.notify_one();
+}
+
+bool PTZWorkerPool::pop(size_t index, Task &task)
+{
+	{
+		auto &w = workers[index];
+		std::lock_guard<std::mutex> guard(w->lock);
+		if (!w->tasks.empty()) {
+			task = std::move(w->tasks.front());
+			w->tasks.pop_front();
+			return true;
+		}
+	}
+	for (size_t i = 1; i < workers.size(); i++) {
+		auto &victim = workers[(index + i) % workers.size()];
+		std::lock_guard<std::mutex> guard(victim->lock);
+		if (!victim->tasks.empty()) {
+			task = std::move(victim->tasks.back());
+			victim->tasks.pop_back();
+			stolen_count++;
+			return true;
+		}
+	}
+	return false;
+}
+
+void PTZWorkerPool::run(size_t index)
+{
+	current_worker = (int)index;
+	os_set_thread_name("ptz-worker");
+	Task task;
+	while (true) {
+		{
+			std::unique_lock<std::mutex> guard(idle_lock);
+			/* pending counts tasks not yet claimed. Claiming one here
+			 * means a worker whose task was stolen goes back to sleep
+			 * instead of spinning until the thief is done with it */
+			idle_cond.wait(guard, [this]() { return stopping || pending > 0; });
+			if (stopping && pending == 0)
+				return;
+			pending--;
+		}
+		/* Tasks are queued before pending is raised, so a claimed task
+		 * is always there. The scan can still miss it if other workers
+		 * race for the same deques, so retry until one is found */
+		while (!pop(index, task))
+			std::this_thread::yield();
+		task();
+		task = nullptr;
+		executed_count++;
+	}
+}
+
+/* The pool is only started on first use; report nothing until then */
+void PTZWorkerPool::writeStatistics(obs_data_t *data)
+{
+	if (!pool)
+		return;
+	obs_data_set_int(data, "worker_pool_threads", pool->workers.size());
+	obs_data_set_int(data, "worker_pool_executed_count", pool->executed_count);
+	obs_data_set_int(data, "worker_pool_stolen_count", pool->stolen_count);
+}
+
+PTZStrand::~PTZStrand()
+{
+	close();
+}
+
+std::shared_ptr<PTZStrand> PTZStrand::createDedicated(PTZWorkerPool::Task thread_init, PTZWorkerPool::Task thread_exit)
+{
+	auto strand = std::make_shared<PTZStrand>();
+	strand->thread_exit = std::move(thread_exit);
+	strand->thread = std::thread(&PTZStrand::runDedicated, strand.get(), std::move(thread_init));
+	return strand;
+}
+
+void PTZStrand::post(PTZWorkerPool::Task task)
+{
+	std::lock_guard<std::mutex> guard(lock);
+	if (closed)
+		return;
+	tasks.push_back(std::move(task));
+	if (thread.joinable()) {
+		work_cond.notify_one();
+		return;
+	}
+	if (running)
+		return;
+	running = true;
+	auto self = shared_from_this();
+	PTZWorkerPool::instance()->submit([self]() { self->run(); });
+}
+
+/* Run a bounded batch of tasks, then yield the worker back to the pool so that
+ * a busy strand cannot monopolize a thread */
+void PTZStrand::run()
+{
+	current_strand = this;
+	for (int i = 0; i < batch_limit; i++) {
+		PTZWorkerPool::Task task;
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			if (tasks.empty()) {
+				running = false;
+				idle_cond.notify_all();
+				current_strand = nullptr;
+				return;
+			}
+			task = std::move(tasks.front());
+			tasks.pop_front();
+		}
+		task();
+	}
+	current_strand = nullptr;
+
+	std::lock_guard<std::mutex> guard(lock);
+	if (tasks.empty()) {
+		running = false;
+		idle_cond.notify_all();
+		return;
+	}
+	auto self = shared_from_this();
+	PTZWorkerPool::instance()->submit([self]() { self->run(); });
+}
+
+void PTZStrand::runDedicated(PTZWorkerPool::Task thread_init)
+{
+	os_set_thread_name("ptz-strand");
+	current_strand = this;
+	if (thread_init)
+		thread_init();
+	std::unique_lock<std::mutex> guard(lock);
+	while (true) {
+		work_cond.wait(guard, [this]() { return closed || !tasks.empty(); });
+		if (closed)
+			break;
+		auto task = std::move(tasks.front());
+		tasks.pop_front();
+		running = true;
+		guard.unlock();
+		task();
+		task = nullptr;
+		guard.lock();
+		running = false;
+	}
+	guard.unlock();
+	if (thread_exit)
+		thread_exit();
+	current_strand = nullptr;
+}
+
+void PTZStrand::close()
+{
+	std::unique_lock<std::mutex> guard(lock);
+	closed = true;
+	tasks.clear();
+	/* A task closing its own strand can't wait for itself */
+	if (current_strand == this)
+		return;
+	if (thread.joinable()) {
+		work_cond.notify_one();
+		guard.unlock();
+		thread.join();
+		return;
+	}
+	idle_cond.wait(guard, [this]() { return !running; });
+}
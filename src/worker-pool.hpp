@@ -0,0 +1,102 @@
+/* Work-stealing worker pool and per-device strands
+ *
+ * Copyright 2026 agent <agent@local>
+ *
+ * SPDX-License-Identifier: GPLv2
+ */
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <obs.hpp>
+
+/*
+ * Blocking or CPU heavy protocol work (XML parsing, V4L2 ioctls, etc.) is run
+ * on a small pool of worker threads sized to the number of cores instead of on
+ * the Qt main loop. Each worker owns a task deque; a worker pops new work from
+ * the front of its own deque and steals from the back of the other workers'
+ * deques when it runs out.
+ */
+class PTZWorkerPool {
+public:
+	typedef std::function<void()> Task;
+
+private:
+	struct Worker {
+		std::mutex lock;
+		std::deque<Task> tasks;
+		std::thread thread;
+	};
+	std::vector<std::unique_ptr<Worker>> workers;
+	std::mutex idle_lock;
+	std::condition_variable idle_cond;
+	std::atomic<size_t> pending{0};
+	std::atomic<size_t> next_worker{0};
+	bool stopping = false;
+
+	/* Statistics */
+	std::atomic<uint64_t> executed_count{0};
+	std::atomic<uint64_t> stolen_count{0};
+
+	bool pop(size_t index, Task &task);
+	void run(size_t index);
+
+public:
+	PTZWorkerPool();
+	~PTZWorkerPool();
+	static PTZWorkerPool *instance();
+	static void shutdown();
+
+	void submit(Task task);
+	size_t size() const { return workers.size(); }
+	static void writeStatistics(obs_data_t *data);
+};
+
+/*
+ * PTZStrand - Serialized task queue on top of the worker pool
+ *
+ * Tasks posted to a strand run one at a time in the order they were posted,
+ * but on whichever pool worker is free. Each device owns a strand, so work for
+ * one device is never reordered while different devices run in parallel and a
+ * slow device cannot hold up the others.
+ */
+class PTZStrand : public std::enable_shared_from_this<PTZStrand> {
+private:
+	static const int batch_limit = 16;
+	std::mutex lock;
+	std::condition_variable idle_cond;
+	std::deque<PTZWorkerPool::Task> tasks;
+	bool running = false;
+	bool closed = false;
+
+	/* Dedicated strands run on their own thread instead of the pool */
+	std::thread thread;
+	std::condition_variable work_cond;
+	PTZWorkerPool::Task thread_exit;
+
+	void run();
+	void runDedicated(PTZWorkerPool::Task thread_init);
+
+public:
+	~PTZStrand();
+	static std::shared_ptr<PTZStrand> create() { return std::make_shared<PTZStrand>(); }
+
+	/* For APIs with thread affinity (e.g. COM objects), which must be
+	 * created, used and released on the same thread. thread_init runs first
+	 * on the new thread, and thread_exit runs on it when the strand is
+	 * closed, after the last task. */
+	static std::shared_ptr<PTZStrand> createDedicated(PTZWorkerPool::Task thread_init,
+							  PTZWorkerPool::Task thread_exit);
+
+	void post(PTZWorkerPool::Task task);
+
+	/* Drop any queued tasks and wait for a running task to finish. Must be
+	 * called by the owner before any state used by the tasks is destroyed. */
+	void close();
+};